@@ -0,0 +1,127 @@
+// host benchmark of the response framing, INFO decoders, fixed point text and readings JSON, pio run -e bench && .pio/build/bench/program [iterations]
+// the same cases as cmnd/benchmark without the ESP32 in the loop, for comparing a change before flashing it; the on-device run stays the reference for absolute numbers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ArduinoJson.h>
+#include "FixedPoint.h"
+#include "FrameDecode.h"
+#include "ReadingsJson.h"
+
+using namespace PylonToMQTT;
+
+#define BENCH_ITERATIONS 100000 // default repetitions per case
+
+// captured responses from a US2000C bank, see Docs/*.txt
+const char _analogValueFrame[] = "~25014600D07C0001100D200D240D240D210D210D220D230D240D220D210D220D220D230D220D230D21060B230B210B270B260B450B4E0050D22327CF0227D6000B271063E372";
+const char _alarmInfoFrame[] = "~25014600E04E00011002020202010101000000000000000001060201010101020002020080A600000000000000EEA1";
+
+static volatile size_t _sink; // keeps the results of the timed loops alive
+
+typedef std::chrono::steady_clock BenchClock;
+
+static void report(const char *name, int iterations, BenchClock::time_point start, size_t bytes)
+{
+	double elapsed = std::chrono::duration<double, std::micro>(BenchClock::now() - start).count();
+	printf("\"%s\":{\"total_us\":%.0f,\"us_per_op\":%.3f,\"ops_per_sec\":%.0f,\"bytes\":%zu},\n", name, elapsed, elapsed / iterations, elapsed > 0 ? iterations * 1e6 / elapsed : 0, bytes);
+}
+
+static bool decode(const char *frame, std::vector<uint8_t> &bytes, FrameHeader &header)
+{
+	return DecodeFrame(frame, strlen(frame), bytes, header) == FrameOk;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : BENCH_ITERATIONS;
+	if (iterations < 1)
+	{
+		iterations = BENCH_ITERATIONS;
+	}
+	static BankReadings readings;
+	std::vector<std::string> tempKeys = {"CellTemp1_4", "CellTemp5_8", "CellTemp9_12", "CellTemp13_16", "MOS_T", "ENV_T"};
+	std::vector<uint8_t> bytes;
+	FrameHeader header;
+	uint16_t cells;
+	uint16_t temps;
+	printf("{\"iterations\":%d,\n", iterations);
+
+	BenchClock::time_point start = BenchClock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		_sink = decode(_analogValueFrame, bytes, header);
+	}
+	report("DecodeFrame", iterations, start, strlen(_analogValueFrame));
+
+	start = BenchClock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		decode(_analogValueFrame, bytes, header);
+		FrameReader info(bytes.data() + 6, header.LenId / 2);
+		_sink = DecodeAnalog(info, readings, 0, MAX_TEMPS, cells, temps);
+	}
+	report("AnalogValueFixedPoint", iterations, start, strlen(_analogValueFrame));
+
+	start = BenchClock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		decode(_alarmInfoFrame, bytes, header);
+		FrameReader info(bytes.data() + 6, header.LenId / 2);
+		_sink = DecodeAlarm(info, readings, 0, MAX_TEMPS);
+	}
+	report("AlarmInfo", iterations, start, strlen(_alarmInfoFrame));
+
+	// every cell voltage of the pack as printed in the readings
+	size_t len = 0;
+	start = BenchClock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		len = 0;
+		for (int c = 0; c < readings.NumberOfCells[0]; c++)
+		{
+			len += FixedPoint(readings.CellMillivolts[0][c], 3).Length;
+		}
+		_sink = len;
+	}
+	report("FixedPoint", iterations, start, len);
+
+	// full 16 cell readings document as published on readings/PackN
+	uint8_t sections = AnalogSection | AlarmSection;
+	start = BenchClock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		JsonDocument doc;
+		BuildReadings(doc.to<JsonObject>(), readings, 0, sections, tempKeys, false);
+		_sink = doc.size();
+	}
+	report("build", iterations, start, 0);
+
+	JsonDocument doc;
+	BuildReadings(doc.to<JsonObject>(), readings, 0, sections, tempKeys, false);
+	std::string s;
+	start = BenchClock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		s.clear();
+		serializeJson(doc, s);
+		_sink = s.size();
+	}
+	report("serialize", iterations, start, s.size());
+
+	// the same document with the status bytes as integers and no decoded groups
+	start = BenchClock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		JsonDocument compact;
+		BuildReadings(compact.to<JsonObject>(), readings, 0, sections, tempKeys, true, false);
+		s.clear();
+		serializeJson(compact, s);
+		_sink = s.size();
+	}
+	report("compact", iterations, start, s.size());
+	printf("\"ok\":true}\n");
+	return 0;
+}
@@ -0,0 +1,5 @@
+Import("env")
+
+# libFuzzer ships with clang, the native platform defaults to gcc
+env.Replace(CC="clang", CXX="clang++", LINK="clang++")
+env.Append(LINKFLAGS=["-fsanitize=fuzzer,address"])
@@ -0,0 +1,67 @@
+// libFuzzer target for the response framing and the INFO field decoders, pio run -e fuzz && .pio/build/fuzz/program fuzz/corpus
+// the first byte selects the input: 'A', 'L' or 'C' is an ASCII response from SOI to CHKSUM whose INFO goes through the
+// AnalogValueFixedPoint, AlarmInfo or GetPackCount decoder, 'F' a response that is only framed (GetVersionInfo, GetBarCode),
+// any other byte is followed by a decoded INFO field, the byte modulo 3 picks the decoder
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "FrameDecode.h"
+
+using namespace PylonToMQTT;
+
+static void decode(uint8_t decoder, FrameReader &info)
+{
+	static BankReadings readings;
+	switch (decoder)
+	{
+	case 0:
+	{
+		uint16_t cells;
+		uint16_t temps;
+		if (DecodeAnalog(info, readings, MAX_PACKS - 1, MAX_TEMPS, cells, temps) && (readings.NumberOfCells[MAX_PACKS - 1] > MAX_CELLS || readings.NumberOfTemps[MAX_PACKS - 1] > MAX_TEMPS))
+		{
+			__builtin_trap(); // counts must stay within the arrays the publishers walk
+		}
+	}
+	break;
+	case 1:
+		DecodeAlarm(info, readings, MAX_PACKS - 1, MAX_TEMPS);
+		break;
+	case 2:
+	{
+		uint8_t count;
+		DecodePackCount(info, count);
+	}
+	break;
+	}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (size < 1)
+	{
+		return 0;
+	}
+	const char *frames = "ALCF";
+	const char *selected = data[0] != '\0' ? strchr(frames, data[0]) : NULL;
+	if (selected == NULL)
+	{
+		FrameReader info(data + 1, size - 1);
+		decode(data[0] % 3, info);
+		return 0;
+	}
+	std::vector<uint8_t> bytes;
+	FrameHeader header;
+	if (DecodeFrame((const char *)data + 1, size - 1, bytes, header) != FrameOk)
+	{
+		return 0;
+	}
+	if (bytes.size() < 6 + header.LenId / 2)
+	{
+		__builtin_trap(); // ParseResponse reads the INFO field by LENID
+	}
+	FrameReader info(bytes.data() + 6, header.LenId / 2);
+	decode(selected - frames, info);
+	return 0;
+}
@@ -11,12 +11,14 @@ class AsyncSerial
  public:
 	AsyncSerial();
 	~AsyncSerial();
-	void begin(AsyncSerialCallbackInterface* cbi, unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin);
+	void begin(AsyncSerialCallbackInterface* cbi, Stream* stream); // the caller sets up the UART
 	void Receive(int timeOut);
 	void Send(CommandInformation cmd, byte* data, size_t dataLength);
 	byte* GetContent();
 	uint16_t GetContentLength();
 	CommandInformation GetToken() { return _command; };
+	bool Idle() { return _status == IDDLE; };
+	unsigned long GetCompleteTime() { return _completeTime; }; // Clock::Millis() when the last EOI was read
 
 	unsigned long Timeout = 0;
 	char EOIChar = '\r';
@@ -29,6 +31,7 @@ class AsyncSerial
 	 size_t _bufferIndex;
 	 size_t _bufferLength;
 	 unsigned long _startTime;
+	 unsigned long _completeTime = 0;
 	 Status _status;
 	 CommandInformation _command; 
 	 AsyncSerialCallbackInterface* _cbi;
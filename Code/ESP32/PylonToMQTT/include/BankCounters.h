@@ -0,0 +1,24 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+namespace PylonToMQTT
+{
+
+// serial, snapshot, duty cycle and data age figures of one bank, owned by its Pylon and rendered with the bank's label
+struct BankCounters
+{
+	std::atomic<uint32_t> FramesSent{0};
+	std::atomic<uint32_t> FramesReceived{0};
+	std::atomic<uint32_t> ChecksumFailures{0};
+	std::atomic<uint32_t> Timeouts{0};
+	std::atomic<uint32_t> Overflows{0};
+	std::atomic<uint32_t> SnapshotOverruns{0};
+	std::atomic<float> AverageMilliamps{0}; // low power mode, the bank task's last poll cycle
+	std::atomic<float> DutyPercent{0};
+	std::atomic<uint32_t> DataAgeMillis{0}; // EOI to the MQTT client taking the bank's last readings from the queue
+	std::atomic<uint32_t> DataAgeMaxMillis{0}; // oldest of the bank's last poll cycle
+	std::atomic<uint32_t> DataAgeCycleMillis{0}; // oldest so far in this poll cycle, moved to DataAgeMaxMillis when it completes
+};
+
+} // namespace PylonToMQTT
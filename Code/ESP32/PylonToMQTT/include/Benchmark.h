@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "IOTServiceInterface.h"
+#include "Pylon.h"
+
+#define BENCHMARK_ITERATIONS 100 // default repetitions per case, override with {"iterations":n} on cmnd/benchmark
+#define BENCHMARK_MAX_ITERATIONS 10000
+
+namespace PylonToMQTT
+{
+
+// micro benchmarks of the parse, serialize and discovery paths using captured frames from Docs/*.txt,
+// runs on a scratch Pylon whose publishes are measured and discarded so the live packs are not touched
+class Benchmark : public Pylon, public IOTServiceInterface
+{
+public:
+	Benchmark(IOTServiceInterface *psi)
+	{
+		_names = psi;
+		_psi = this;
+		_traced = false;
+	};
+
+	void Run(int iterations, JsonDocument &results);
+
+	// IOTServiceInterface, publishes are serialized like the MQTT client does and then dropped
+	boolean Publish(const char *subtopic, const char *value, boolean retained, uint32_t sampleMillis) { _publishedBytes = strlen(value); return true; };
+	boolean Publish(const char *subtopic, float value, boolean retained) { return true; };
+	boolean Publish(const char *subtopic, JsonDocument &payload, boolean retained) { return PublishMessage(subtopic, payload, retained); };
+	boolean PublishMessage(const char *topic, JsonDocument &payload, boolean retained)
+	{
+		String s;
+		serializeJson(payload, s);
+		_publishedBytes = s.length();
+		return true;
+	};
+	boolean PublishHADiscovery(const char *bank, JsonDocument &payload) { return PublishMessage(bank, payload, true); };
+	std::string getRootTopicPrefix() { return _names->getRootTopicPrefix(); };
+	std::string getSubtopicName() { return _names->getSubtopicName(); };
+	u_int getUniqueId() { return _names->getUniqueId(); };
+	std::string getThingName() { return _names->getThingName(); };
+	std::string getWillTopic() { return _names->getWillTopic(); };
+	void Online() {};
+	boolean Connected() { return false; };
+	unsigned long PublishRate() { return _names->PublishRate(); };
+	boolean LowPower() { return false; };
+
+private:
+	void parse(const char *name, const char *frame, CommandInformation cmd, int iterations, JsonObject results);
+	void report(JsonObject result, int iterations, uint32_t elapsed);
+
+	IOTServiceInterface *_names;
+	size_t _publishedBytes = 0;
+};
+
+} // namespace PylonToMQTT
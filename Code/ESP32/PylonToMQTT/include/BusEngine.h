@@ -0,0 +1,155 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "IOTServiceInterface.h"
+#include "AsyncSerial.h"
+#include "Pack.h"
+#include "PackReadings.h"
+#include "BankCounters.h"
+#include "Latency.h"
+#include "SpscQueue.h"
+#include "Seqlock.h"
+#include "DutyCycle.h"
+#include "BusSchedule.h"
+#include "Clock.h"
+#include "Defines.h"
+#include "Log.h"
+
+namespace PylonToMQTT
+{
+    // on-demand command from cmnd/poll, answered on stat/poll/<Id>
+    struct PollRequest
+    {
+        uint8_t Pack;
+        CommandInformation Command;
+        char Id[POLL_ID_LEN];
+        bool Capture; // sample of a burst capture, not published on its own
+    };
+
+    // burst capture of one pack requested on cmnd/capture or /api/capture
+    struct CaptureRequest
+    {
+        uint8_t Pack;
+        uint16_t Seconds;
+    };
+
+    struct CaptureSample
+    {
+        uint32_t Millis; // since the capture started
+        uint16_t VoltageMillivolts;
+        int16_t CurrentCentiamps;
+    };
+
+    // Bus core side of a bank: the command schedule, response parsing and the snapshots handed to the publisher.
+    // Free of the network and FreeRTOS calls so the native tests drive the same Step() the bus task runs, on a virtual clock.
+    class BusEngine : public AsyncSerialCallbackInterface
+    {
+
+    public:
+        BusEngine();
+        virtual ~BusEngine();
+        void Start(Stream *serial); // the caller sets up the UART
+        // one pass of the bus task: receive, the next poll or scheduled command, then wait until the bus is needed again
+        void Step(bool connected, uint32_t publishRate, bool lowPower);
+        // torn-free copy of the bank's latest readings from any task, returns its version (0 until the first pack is read)
+        uint32_t ReadBank(BankReadings &readings) { return _bankReadings.Read(readings); };
+        void Receive(int timeOut) { _asyncSerial->Receive(timeOut); };
+        bool Transmit();
+        bool Poll();
+        int ParseResponse(char *szResponse, size_t readNow, CommandInformation cmd);
+
+        // AsyncSerialCallbackInterface
+        void complete()
+        {
+            _counters.FramesReceived++;
+            _latency.Stop(RoundTripStage, _sendCycles);
+            _frameMillis = _asyncSerial->GetCompleteTime();
+            _frameEpochMillis = _clock->EpochMillis();
+            ParseResponse((char *)_asyncSerial->GetContent(), _asyncSerial->GetContentLength(), _asyncSerial->GetToken());
+        };
+        void overflow()
+        {
+            _counters.Overflows++;
+            loge("AsyncSerial: overflow");
+        };
+        void timeout()
+        {
+            _counters.Timeouts++;
+            loge("AsyncSerial: timeout");
+        };
+
+    protected:
+        virtual void notifyPublisher() {}; // a snapshot or capture is ready for the publisher
+        virtual void saveTopology() { _topologyDirty = false; }; // persists _Packs once a sequence changed them
+
+        uint8_t _infoCommandIndex = 0;
+        uint8_t _readingsCommandIndex = 0;
+        uint8_t _numberOfPacks = 0;
+        uint8_t _currentPack = 0;
+        AsyncSerial *_asyncSerial;
+        IOTServiceInterface *_psi = NULL;
+        CommandInformation _currentCommand = CommandInformation::None;
+
+        uint16_t get_frame_checksum(char *frame);
+        int get_info_length(const char *info);
+        void encode_cmd(char *frame, uint8_t address, uint8_t cid2, const char *info);
+        void send_cmd(uint8_t address, CommandInformation cmd);
+        void createPacks(uint8_t count);
+        bool sendValidationCommand();
+        bool sendEnumerationCommand();
+        void reconcilePacks(uint8_t count);
+        bool queueSnapshot(const PackSnapshot &snapshot);
+        bool queueTopology(uint8_t packIndex, TopologyMessage message);
+        void queueInfo(uint8_t packIndex);
+        void queueDiscovery(uint8_t packIndex);
+        void queuePollResult();
+        bool nextBurst(PollRequest &request);
+        bool nextCapture(PollRequest &request);
+        void captureSample(const PackSnapshot &snapshot);
+        void endCapture();
+        void checkAlarms(int packIndex, const uint8_t *previous);
+
+        bool _topologyDirty = false;
+        uint8_t _validationStep = 0;  // next background check of a cached topology, 0 = pack count, then version/barcode per pack
+        uint8_t _validationSteps = 0; // number of checks pending, 0 when the topology was discovered from the bus
+        BankCounters _counters;
+        Latency _latency; // stage histograms of this bank, reported on its diag topic
+        uint32_t _sendCycles = 0; // cycle count when the last command was written
+        uint32_t _frameMillis = 0; // EOI of the frame being parsed, stamped on the readings
+        uint64_t _frameEpochMillis = 0;
+        bool _validationSent = true;  // at most one check per sequence, none until the first sequence has published
+        uint32_t _lastEnumerationTimeStamp = 0;
+        bool _traced = true; // false on scratch instances so they stay out of the live trace
+        uint8_t _bank = 0; // the first bank also feeds the web pages and modbus
+        BusSchedule _schedule;
+        DutyCycle _dutyCycle = DutyCycle(ACTIVE_CURRENT_MA, SLEEP_CURRENT_MA);
+        std::vector<string> _TempKeys;
+        std::vector<Pack> _Packs;
+
+        // bus core side of the snapshot queue
+        uint8_t _sections = 0; // ReadingsSection bits received for the current pack
+        SpscQueue<PackSnapshot, SNAPSHOT_QUEUE_SIZE> _snapshots;
+        BankReadings _working = {}; // written to _bankReadings as each pack completes
+        Seqlock<BankReadings> _bankReadings;
+
+        // on-demand commands, pushed from the MQTT callback and sent by the bus task ahead of the schedule
+        SpscQueue<PollRequest, POLL_QUEUE_SIZE> _polls;
+        PollRequest _poll = {};
+        bool _pollSent = false;
+        uint8_t _scheduleSections = 0; // _sections of the scheduled pack while a poll is outstanding
+        uint8_t _alarmPacks = 0; // bit per pack with an active alarm bit, burst polled with AlarmInfo
+        uint8_t _burstPack = 0;
+
+        // burst capture, AnalogValueFixedPoint of one pack back-to-back, the samples are handed to the publish task when it ends
+        SpscQueue<CaptureRequest, 2> _captures;
+        CaptureRequest _capture = {};
+        bool _capturing = false;
+        uint32_t _captureStart = 0;
+        uint64_t _captureEpochMillis = 0;
+        uint16_t _captureMissed = 0; // commands without an answer
+        std::vector<CaptureSample> _captureSamples;
+        std::atomic<bool> _captureReady{false}; // the publish task owns the capture while set
+    };
+} // namespace PylonToMQTT
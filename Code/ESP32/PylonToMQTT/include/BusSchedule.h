@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include "Defines.h"
+#include "Clock.h"
+#include "DutyCycle.h"
+
+namespace PylonToMQTT
+{
+
+// When the bus task sends its next scheduled command and AlarmInfo burst poll, free of Arduino calls so the host tests can run it on a virtual clock.
+// Commands of a sequence go out COMMAND_PUBLISH_RATE apart, a completed sequence waits for the publish rate.
+class BusSchedule
+{
+public:
+	void Start(uint32_t now)
+	{
+		_due = now + COMMAND_PUBLISH_RATE;
+	}
+
+	bool Due(uint32_t now) const { return !Clock::Elapsed(_due, now); }; // from due on, a low power wake at due sends without another wait
+
+	void Sent(uint32_t now, bool sequenceComplete, uint32_t publishRate)
+	{
+		_due = now + (sequenceComplete ? publishRate : COMMAND_PUBLISH_RATE);
+	}
+
+	bool BurstDue(uint32_t now) const { return now - _lastBurst >= ALARM_BURST_RATE; };
+
+	void Burst(uint32_t now)
+	{
+		_lastBurst = now;
+	}
+
+	// ms until the schedule, or a burst poll while alarms are active, needs the bus
+	uint32_t IdleTime(uint32_t now, bool alarms) const
+	{
+		uint32_t due = _due;
+		if (alarms && (int32_t)(_lastBurst + ALARM_BURST_RATE - due) < 0)
+		{
+			due = _lastBurst + ALARM_BURST_RATE;
+		}
+		return DutyCycle::SleepTime(now, due, MAX_PUBLISH_RATE);
+	}
+
+private:
+	uint32_t _due = 0;
+	uint32_t _lastBurst = 0;
+};
+
+} // namespace PylonToMQTT
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+
+namespace PylonToMQTT
+{
+
+// Time source of the polling engine, millis() and the FreeRTOS delay on the device.
+// A simulation installs a virtual clock so poll cycles, serial timeouts and publish cadence run without real waits.
+class Clock
+{
+public:
+	virtual uint32_t Millis() = 0;
+	virtual void Delay(uint32_t ms) = 0; // blocks the calling task
+	virtual void Wait(uint32_t ms) = 0; // blocks the calling task for ms or until it is notified
+	virtual uint64_t EpochMillis() = 0; // NTP time, 0 until the clock has been synced
+
+	// true once due has passed, safe across the 49 day millis() wrap
+	static bool Elapsed(uint32_t now, uint32_t due) { return (int32_t)(now - due) > 0; };
+};
+
+class SystemClock : public Clock
+{
+public:
+	uint32_t Millis();
+	void Delay(uint32_t ms);
+	void Wait(uint32_t ms);
+	uint64_t EpochMillis();
+};
+
+extern Clock *_clock;
+
+} // namespace PylonToMQTT
@@ -12,7 +12,34 @@
 #define NUMBER_CONFIG_LEN 6
 #define DEFAULT_AP_PASSWORD "12345678"
 
+#define BUS_CORE 1 // battery polling, shared with the Arduino loop (configuration portal)
+#define NETWORK_CORE 0 // Wi-Fi, lwIP, MQTT and web publishers
+#define SNAPSHOT_QUEUE_SIZE 16 // pack snapshots in flight between the bus and network cores, power of two
+#define MAX_BANKS 2 // battery banks, one per UART (Serial2, Serial1)
+#define MAX_PACKS 8 // packs per bank
+#define MAX_CELLS 16 // cells per pack
+#define MAX_TEMPS 6 // temperature sensors per pack
+#define PACK_ENUMERATION_RATE 60000 // time in ms between background pack counts, packs are added or removed without a reboot
+#define ALARM_BURST_RATE 250 // time in ms between AlarmInfo polls of a pack with an active protect, fault or alarm bit
+#define POLL_QUEUE_SIZE 4 // on-demand commands waiting for the bus, power of two
+#define POLL_ID_LEN 16 // correlation id of an on-demand command, used as the response subtopic
+#define VERSION_INFO_LEN 20 // GetVersionInfo text kept per pack, with terminator
+#define BAR_CODE_LEN 16 // GetBarCode text kept per pack, with terminator
+#define CAPTURE_SAMPLES 512 // burst capture buffer, 8 bytes per sample, allocated while a capture runs
+#define CAPTURE_MAX_SECONDS 60
+#define CAPTURE_DEFAULT_SECONDS 10
+#define MQTT_QUEUE_SIZE 32 // outbound messages waiting for the MQTT client
+#define MQTT_QUEUE_BYTES 24576 // topic and payload bytes waiting for the MQTT client
+#define MQTT_IN_FLIGHT 4 // published messages waiting for the broker's PUBACK
+#define MQTT_IN_FLIGHT_BYTES 8192 // bytes handed to the client before the broker acknowledges them
+#define MQTT_ACK_TIMEOUT 5000 // time in ms before unacknowledged messages stop holding the window
+
 #define MAX_PUBLISH_RATE 30000
+#define LOW_POWER_CPU_MHZ 80 // lowest clock Wi-Fi runs at
+#define LOW_POWER_LOOP_DELAY 20 // time in ms the Arduino loop (configuration portal) yields between passes in low power mode
+#define LOW_POWER_KEEPALIVE 60 // MQTT keepalive in s, each ping wakes the radio outside its listen interval
+#define ACTIVE_CURRENT_MA 95.0 // modelled draw while the bus task is awake, 80 MHz with the radio listening
+#define SLEEP_CURRENT_MA 20.0 // modelled draw with the CPUs halted and Wi-Fi in modem sleep
 #define MIN_PUBLISH_RATE 1000
 #define CheckBit(var,pos) ((var) & (1<<(pos))) ? true : false
 #define toShort(i, v) (v[i++]<<8) | v[i++]
@@ -23,3 +50,5 @@
 #define IOTCONFIG_PORT 80
 #define WSOCKET_LOG_PORT 7668
 #define WSOCKET_HOME_PORT 7669
+#define MODBUS_TCP_PORT 502
+#define MODBUS_MAX_CLIENTS 4
@@ -0,0 +1,69 @@
+#pragma once
+#include <stdint.h>
+
+namespace PylonToMQTT
+{
+
+// Bookkeeping for the low power mode, free of Arduino calls so it can be driven by a simulated clock.
+// The bus task reports when it wakes and blocks, each poll cycle turns the awake time into an average current.
+class DutyCycle
+{
+public:
+	DutyCycle(float activeMilliamps, float sleepMilliamps) : _activeMilliamps(activeMilliamps), _sleepMilliamps(sleepMilliamps) {};
+
+	// ms the task may block before due, at least 1 and at most limit
+	static uint32_t SleepTime(uint32_t now, uint32_t due, uint32_t limit)
+	{
+		int32_t remaining = (int32_t)(due - now);
+		if (remaining < 1)
+		{
+			return 1;
+		}
+		return (uint32_t)remaining < limit ? remaining : limit;
+	}
+
+	void Awake(uint32_t now)
+	{
+		_awakeSince = now;
+		_awake = true;
+	}
+
+	void Asleep(uint32_t now)
+	{
+		if (_awake)
+		{
+			_activeTime += now - _awakeSince;
+			_awake = false;
+		}
+	}
+
+	void CycleComplete(uint32_t now)
+	{
+		Asleep(now);
+		uint32_t cycle = now - _cycleStart;
+		if (cycle > 0)
+		{
+			float duty = _activeTime < cycle ? (float)_activeTime / cycle : 1.0;
+			_dutyPercent = duty * 100.0;
+			_averageMilliamps = _activeMilliamps * duty + _sleepMilliamps * (1.0 - duty);
+		}
+		_cycleStart = now;
+		_activeTime = 0;
+		Awake(now);
+	}
+
+	float DutyPercent() const { return _dutyPercent; };
+	float AverageMilliamps() const { return _averageMilliamps; };
+
+private:
+	float _activeMilliamps;
+	float _sleepMilliamps;
+	uint32_t _cycleStart = 0;
+	uint32_t _awakeSince = 0;
+	uint32_t _activeTime = 0;
+	bool _awake = false;
+	float _dutyPercent = 100.0;
+	float _averageMilliamps = 0;
+};
+
+} // namespace PylonToMQTT
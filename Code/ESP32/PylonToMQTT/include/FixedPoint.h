@@ -0,0 +1,48 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace PylonToMQTT
+{
+
+#define FIXED_POINT_LEN 13 // sign, 10 digits, decimal point and terminator
+
+// Exact decimal text for a reading held as a scaled integer, 3312 mV with 3 decimals is "3.312".
+// Integer only, avoids the soft float formatter and artifacts like 3.3119999. decimals at most 9.
+inline size_t formatFixed(char *buffer, int32_t value, uint8_t decimals)
+{
+	char digits[FIXED_POINT_LEN];
+	uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+	size_t count = 0;
+	do // least significant first, at least one digit before the point
+	{
+		digits[count++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while (magnitude > 0 || count <= decimals);
+	size_t len = 0;
+	if (value < 0)
+	{
+		buffer[len++] = '-';
+	}
+	while (count > 0)
+	{
+		if (count == decimals)
+		{
+			buffer[len++] = '.';
+		}
+		buffer[len++] = digits[--count];
+	}
+	buffer[len] = 0;
+	return len;
+}
+
+// formatted value that can be handed to printf or serialized() within one expression
+struct FixedPoint
+{
+	FixedPoint(int32_t value, uint8_t decimals) { Length = formatFixed(Text, value, decimals); };
+
+	char Text[FIXED_POINT_LEN];
+	size_t Length;
+};
+
+} // namespace PylonToMQTT
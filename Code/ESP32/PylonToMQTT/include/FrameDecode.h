@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "Defines.h"
+#include "FrameReader.h"
+#include "PackReadings.h"
+
+namespace PylonToMQTT
+{
+
+// header of a response frame, VER ADR CID1 CID2 LENGTH, ahead of the INFO field
+struct FrameHeader
+{
+	uint8_t Version;
+	uint8_t Address;
+	uint8_t Cid1;
+	uint8_t Cid2;
+	uint16_t Length; // LCHKSUM nibble and LENID
+	uint16_t LenId;	 // INFO length in ASCII characters
+	uint16_t Checksum;
+};
+
+enum FrameStatus : uint8_t
+{
+	FrameOk,
+	FrameTooShort,
+	FrameChecksumError,
+	FrameLengthError, // LENID is longer than the INFO received
+};
+
+// checks the ASCII hex frame from SOI to CHKSUM (length characters, without the EOI) and converts VER through INFO to bytes,
+// on FrameOk bytes holds the 6 header bytes and at least LenId / 2 INFO bytes, whatever characters the frame carries
+FrameStatus DecodeFrame(const char *ascii, size_t length, std::vector<uint8_t> &bytes, FrameHeader &header);
+
+// INFO field decoders of the polled responses, free of Arduino calls so the host fuzz target can drive them.
+// Each checks the length of the whole field group first and leaves readings untouched when it does not fit.
+
+// INFO header of AnalogValueFixedPoint and AlarmInfo, the low byte addresses the pack, 0 when missing
+inline uint16_t InfoHeader(const FrameReader &info)
+{
+	return info.Fits(2) ? (info.Peek(0) << 8) | info.Peek(1) : 0;
+}
+
+// the decoders write the slot of pack (< MAX_PACKS) in readings, cells and temps are the counts on the wire,
+// readings keep at most MAX_CELLS and maxTemps of them
+bool DecodeAnalog(FrameReader &info, BankReadings &readings, uint8_t pack, uint8_t maxTemps, uint16_t &cells, uint16_t &temps);
+bool DecodeAlarm(FrameReader &info, BankReadings &readings, uint8_t pack, uint8_t maxTemps);
+bool DecodePackCount(FrameReader &info, uint8_t &count);
+
+} // namespace PylonToMQTT
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace PylonToMQTT
+{
+
+// cursor over the decoded INFO field of a response, callers check the length of a whole field group
+// once with Fits() (using Peek() for counts that come from the wire) so the reads themselves are unchecked
+class FrameReader
+{
+public:
+	FrameReader(const uint8_t *data, size_t length) : _data(data), _length(length) {};
+
+	bool Fits(size_t count) const { return count <= _length - _position; };
+	uint8_t Peek(size_t offset) const { return _data[_position + offset]; };
+	uint8_t Byte() { return _data[_position++]; };
+	uint16_t Short()
+	{
+		uint16_t value = (_data[_position] << 8) | _data[_position + 1];
+		_position += 2;
+		return value;
+	};
+	void Skip(size_t count) { _position += count; };
+	const uint8_t *Data() const { return _data + _position; };
+	size_t Remaining() const { return _length - _position; };
+
+private:
+	const uint8_t *_data;
+	size_t _length;
+	size_t _position = 0;
+};
+
+} // namespace PylonToMQTT
@@ -0,0 +1,81 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#define HISTOGRAM_SUB_BUCKETS 4 // per power of two, bucket width is at most 25% of its value
+#define HISTOGRAM_BUCKETS 96	// covers up to 2^24
+
+// fixed bucket log scale histogram, percentiles are reported as the upper bound of their bucket
+class Histogram
+{
+public:
+	Histogram() { Reset(); };
+
+	void Add(uint32_t value)
+	{
+		uint8_t index = bucket(value);
+		_buckets[index < HISTOGRAM_BUCKETS ? index : HISTOGRAM_BUCKETS - 1]++;
+		_count++;
+		if (value > _max)
+		{
+			_max = value;
+		}
+	}
+
+	uint32_t Percentile(uint8_t percent) const
+	{
+		if (_count == 0)
+		{
+			return 0;
+		}
+		uint32_t rank = ((uint64_t)_count * percent + 99) / 100;
+		uint32_t seen = 0;
+		for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+		{
+			seen += _buckets[i];
+			if (seen >= rank)
+			{
+				uint32_t upper = upperBound(i);
+				return upper < _max ? upper : _max;
+			}
+		}
+		return _max;
+	}
+
+	uint32_t Count() const { return _count; }
+	uint32_t Max() const { return _max; }
+
+	void Reset()
+	{
+		memset(_buckets, 0, sizeof(_buckets));
+		_count = 0;
+		_max = 0;
+	}
+
+private:
+	static uint8_t bucket(uint32_t value)
+	{
+		if (value < HISTOGRAM_SUB_BUCKETS)
+		{
+			return value;
+		}
+		uint8_t octave = 31 - __builtin_clz(value); // >= 2
+		uint8_t sub = (value >> (octave - 2)) & (HISTOGRAM_SUB_BUCKETS - 1);
+		return (octave - 1) * HISTOGRAM_SUB_BUCKETS + sub;
+	}
+
+	static uint32_t upperBound(uint8_t index)
+	{
+		if (index < HISTOGRAM_SUB_BUCKETS)
+		{
+			return index;
+		}
+		uint8_t octave = index / HISTOGRAM_SUB_BUCKETS + 1;
+		uint8_t sub = index % HISTOGRAM_SUB_BUCKETS;
+		return ((HISTOGRAM_SUB_BUCKETS + sub + 1) << (octave - 2)) - 1;
+	}
+
+	uint32_t _buckets[HISTOGRAM_BUCKETS];
+	uint32_t _count;
+	uint32_t _max;
+};
@@ -17,11 +17,46 @@ extern "C"
 #include <IotWebConfOptionalGroup.h>
 #include <IotWebConfTParameter.h>
 #include "Defines.h"
+#include "MqttQueue.h"
 #include "IOTServiceInterface.h"
 #include "IOTCallbackInterface.h"
 
 namespace PylonToMQTT
 {
+    class IOT;
+
+    // publishes an additional battery bank under its own <thing>/<bank> root topic through the shared MQTT client
+    class BankService : public IOTServiceInterface
+    {
+    public:
+        BankService() {};
+        void Init(IOT *iot, uint8_t index, const char *name);
+        void SetCallback(IOTCallbackInterface *iotCB) { _iotCB = iotCB; };
+        IOTCallbackInterface *IOTCB() { return _iotCB; }
+
+        boolean Publish(const char *subtopic, const char *value, boolean retained = false, uint32_t sampleMillis = 0);
+        boolean Publish(const char *subtopic, JsonDocument &payload, boolean retained = false);
+        boolean Publish(const char *subtopic, float value, boolean retained = false);
+        boolean PublishMessage(const char *topic, JsonDocument &payload, boolean retained);
+        boolean PublishHADiscovery(const char *bank, JsonDocument &payload);
+        std::string getRootTopicPrefix() { return _rootTopicPrefix; };
+        std::string getSubtopicName() { return _name; };
+        u_int getUniqueId();
+        std::string getThingName();
+        std::string getWillTopic();
+        void Online();
+        boolean Connected();
+        unsigned long PublishRate();
+        boolean LowPower();
+
+    private:
+        IOT *_iot;
+        IOTCallbackInterface *_iotCB = NULL; // receives <thing>/<bank>/cmnd/#
+        uint8_t _index = 0;
+        std::string _name;
+        std::string _rootTopicPrefix;
+    };
+
     class IOT : public IOTServiceInterface
     {
     public:
@@ -29,20 +64,44 @@ namespace PylonToMQTT
         void Init(IOTCallbackInterface *iotCB);
 
         boolean Run();
-        boolean Publish(const char *subtopic, const char *value, boolean retained = false);
+        boolean Publish(const char *subtopic, const char *value, boolean retained = false, uint32_t sampleMillis = 0);
         boolean Publish(const char *subtopic, JsonDocument &payload, boolean retained = false);
         boolean Publish(const char *subtopic, float value, boolean retained = false);
         boolean PublishMessage(const char *topic, JsonDocument &payload, boolean retained);
+        boolean PublishMessage(const char *topic, const char *payload, boolean retained, uint32_t sampleMillis = 0, uint8_t bank = 0);
         boolean PublishHADiscovery(const char *bank, JsonDocument &payload);
         std::string getRootTopicPrefix();
         std::string getSubtopicName();
         u_int getUniqueId() { return _uniqueId; };
         std::string getThingName();
+        std::string getWillTopic();
         void Online();
+        boolean Connected();
         IOTCallbackInterface *IOTCB() { return _iotCB; }
         unsigned long PublishRate();
+        boolean LowPower();
+        uint8_t BankCount() { return _bankCount; };
+        IOTServiceInterface *Bank(uint8_t index) { return index == 0 ? (IOTServiceInterface *)this : &_banks[index - 1]; };
+        void SetBankCallback(uint8_t index, IOTCallbackInterface *iotCB) { _banks[index - 1].SetCallback(iotCB); }; // from setup, the first bank's is passed to Init
 
     private:
+        struct InFlight
+        {
+            uint16_t PacketId;
+            size_t Bytes;
+        };
+        PublishPriority priorityOf(const char *topic);
+        void drain();
+        void acknowledge(uint16_t packetId);
+        void resetWindow();
+
+        MqttQueue _outbound;
+        InFlight _inFlight[MQTT_IN_FLIGHT];
+        uint8_t _inFlightCount = 0;
+        size_t _inFlightBytes = 0;
+        unsigned long _lastAckTimeStamp = 0;
+        uint8_t _bankCount = 1;
+        BankService _banks[MAX_BANKS - 1]; // banks after the first, which is published by IOT itself
         bool _clientsConfigured = false;
         IOTCallbackInterface *_iotCB;
         u_int _uniqueId = 0; // unique id from mac address NIC segment
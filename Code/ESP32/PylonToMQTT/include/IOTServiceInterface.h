@@ -7,13 +7,18 @@ class IOTServiceInterface
 {
 public:
 
-    virtual boolean Publish(const char *subtopic, const char *value, boolean retained) = 0;
+    virtual boolean Publish(const char *subtopic, const char *value, boolean retained, uint32_t sampleMillis = 0) = 0; // sampleMillis, EOI of the readings for the data age metric
     virtual boolean Publish(const char *subtopic, float value, boolean retained) = 0;
+    virtual boolean Publish(const char *subtopic, JsonDocument &payload, boolean retained) = 0;
     virtual boolean PublishMessage(const char* topic, JsonDocument& payload, boolean retained) = 0;
     virtual boolean PublishHADiscovery(const char *bank, JsonDocument& payload) = 0;
     virtual std::string getRootTopicPrefix() = 0;
     virtual std::string getSubtopicName() = 0;
     virtual u_int getUniqueId() = 0;
     virtual std::string getThingName() = 0;
+    virtual std::string getWillTopic() = 0;
     virtual void Online() = 0;
+    virtual boolean Connected() = 0;
+    virtual unsigned long PublishRate() = 0;
+    virtual boolean LowPower() = 0;
 };
\ No newline at end of file
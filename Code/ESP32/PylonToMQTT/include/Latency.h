@@ -0,0 +1,49 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Histogram.h"
+#include "SharedBuffer.h"
+
+#define DIAG_PUBLISH_RATE 60000 // ms between latency reports on the diag topic
+
+namespace PylonToMQTT
+{
+
+enum LatencyStage : uint8_t
+{
+	EncodeStage,	// send_cmd frame encoding
+	RoundTripStage, // serial TX to EOI
+	DecodeStage,	// checksum, hex decode and field extraction in ParseResponse
+	JsonBuildStage, // building the readings document from a snapshot
+	SerializeStage, // serializeJson of the readings
+	PublishStage,	// handing the readings to the MQTT client
+	LatencyStageCount
+};
+
+// per stage histograms of hot path durations in microseconds, measured with the cpu cycle counter
+// recorded from the bus and publish tasks on both cores, the histograms are only touched under _mux
+class Latency
+{
+public:
+	Latency() {};
+
+	uint32_t Start() { return ESP.getCycleCount(); };
+	void Stop(LatencyStage stage, uint32_t start)
+	{
+		uint32_t elapsed = (ESP.getCycleCount() - start) / max<uint32_t>(ESP.getCpuFreqMHz(), 1); // low power mode changes the cpu clock
+		portENTER_CRITICAL(&_mux);
+		_histograms[stage].Add(elapsed);
+		portEXIT_CRITICAL(&_mux);
+	};
+
+	void Report(JsonDocument &doc);
+	String getSettingsHTML();
+	void Reset();
+
+private:
+	Histogram _histograms[LatencyStageCount];
+	portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+	SharedBuffer _lastReport; // settings page view of the last published window, read from the web server task
+};
+
+} // namespace PylonToMQTT
@@ -5,33 +5,35 @@
 #include <time.h>
 
 int weblog(const char *format, ...);
+bool weblog_set_level(const char *level);
+extern uint8_t weblog_level; // runtime level, can only lower APP_LOG_LEVEL
 
 #if APP_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_VERBOSE
-#define logv(format, ...) weblog(ARDUHAL_LOG_FORMAT(V, format), ##__VA_ARGS__)
+#define logv(format, ...) do { if (weblog_level >= ARDUHAL_LOG_LEVEL_VERBOSE) weblog(ARDUHAL_LOG_FORMAT(V, format), ##__VA_ARGS__); } while (0)
 #else
 #define logv(format, ...)
 #endif
 
 #if APP_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEBUG
-#define logd(format, ...) weblog(ARDUHAL_LOG_FORMAT(D, format), ##__VA_ARGS__)
+#define logd(format, ...) do { if (weblog_level >= ARDUHAL_LOG_LEVEL_DEBUG) weblog(ARDUHAL_LOG_FORMAT(D, format), ##__VA_ARGS__); } while (0)
 #else
 #define logd(format, ...)
 #endif
 
 #if APP_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-#define logi(format, ...) weblog(ARDUHAL_LOG_FORMAT(I, format), ##__VA_ARGS__)
+#define logi(format, ...) do { if (weblog_level >= ARDUHAL_LOG_LEVEL_INFO) weblog(ARDUHAL_LOG_FORMAT(I, format), ##__VA_ARGS__); } while (0)
 #else
 #define logi(format, ...)
 #endif
 
 #if APP_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_WARN
-#define logw(format, ...) weblog(ARDUHAL_LOG_FORMAT(W, format), ##__VA_ARGS__)
+#define logw(format, ...) do { if (weblog_level >= ARDUHAL_LOG_LEVEL_WARN) weblog(ARDUHAL_LOG_FORMAT(W, format), ##__VA_ARGS__); } while (0)
 #else
 #define logw(format, ...)
 #endif
 
 #if APP_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_ERROR
-#define loge(format, ...) weblog(ARDUHAL_LOG_FORMAT(E, format), ##__VA_ARGS__)
+#define loge(format, ...) do { if (weblog_level >= ARDUHAL_LOG_LEVEL_ERROR) weblog(ARDUHAL_LOG_FORMAT(E, format), ##__VA_ARGS__); } while (0)
 #else
 #define loge(format, ...)
 #endif
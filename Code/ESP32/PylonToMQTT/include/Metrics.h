@@ -0,0 +1,50 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <vector>
+#include "Defines.h"
+#include "BankCounters.h"
+#include "MqttQueue.h"
+#include "PackReadings.h"
+#include "Seqlock.h"
+#include "SharedBuffer.h"
+
+class AsyncWebServer;
+
+namespace PylonToMQTT
+{
+
+// Prometheus text exposition on /metrics, rendered once per sequence
+class Metrics
+{
+public:
+	Metrics() {};
+	void begin(AsyncWebServer *pwebServer);
+	void AddBank(const std::string &bank, BankCounters *counters, const Seqlock<BankReadings> *readings); // from setup in bank order, before the first Render
+	void Render(std::vector<std::string> &tempKeys);
+	void DataAge(uint8_t bank, uint32_t age);
+
+	std::atomic<uint32_t> PublishFailures{0};
+	std::atomic<uint32_t> QueueDepth{0};
+	std::atomic<uint32_t> QueueCoalesced{0};
+	std::atomic<uint32_t> QueueDrops[PublishPriorityCount];
+
+private:
+	void appendf(std::string &body, const char *format, ...);
+	void header(std::string &body, const char *name, const char *type, const char *help);
+	void bankCounter(std::string &body, const char *name, const char *help, std::atomic<uint32_t> BankCounters::*counter);
+	void bankValue(std::string &body, const char *name, const char *help, std::atomic<uint32_t> BankCounters::*gauge);
+	void bankGauge(std::string &body, const char *name, const char *help, std::atomic<float> BankCounters::*gauge);
+
+	SharedBuffer _body;
+	BankCounters *_banks[MAX_BANKS] = {};
+	const Seqlock<BankReadings> *_readingsSource[MAX_BANKS] = {};
+	BankReadings _readings[MAX_BANKS]; // copies taken by Render
+	std::string _bankNames[MAX_BANKS];
+	uint8_t _bankCount = 0;
+	bool _started = false;
+};
+
+extern Metrics _metrics;
+
+} // namespace PylonToMQTT
@@ -0,0 +1,91 @@
+#pragma once
+#include <Arduino.h>
+#include <algorithm>
+#include <vector>
+#include "Defines.h"
+#include "PackReadings.h"
+
+// Read only Modbus TCP server, function 03 (holding) and 04 (input) read the same registers.
+// Unit id 1..8 addresses a pack, unit id 0 or 255 addresses the whole bank with pack n at (n - 1) * 100.
+//
+// registers per pack:
+//  0 PackVoltage mV, 1 PackCurrent cA (signed), 2 SOC %, 3 RemainingCapacity cAh, 4 FullCapacity cAh, 5 CycleCount
+//  6 number of cells, 7 number of temperatures, 8 current state, 9 voltage state
+//  10 ProtectSts1, 11 ProtectSts2, 12 SystemSts, 13 FaultSts, 14 AlarmSts1, 15 AlarmSts2
+//  16..31 cell mV, 32..47 cell states, 48..53 temperature dK (2730 = 0°C), 54..59 temperature states
+#define MODBUS_PACK_REGISTERS 60
+#define MODBUS_BANK_STRIDE 100
+#define MBAP_SIZE 7
+#define MODBUS_MAX_FRAME 260
+#define MODBUS_MAX_READ 125
+
+namespace PylonToMQTT
+{
+
+class ModbusServer
+{
+public:
+	ModbusServer() {};
+	void begin();
+	void Update(const BankReadings &readings);
+	size_t HandleRequest(const uint8_t *request, size_t length, uint8_t *response);
+
+private:
+	void encodePack(uint16_t *registers, const BankReadings &readings, uint8_t pack);
+	size_t exception(const uint8_t *request, uint8_t code, uint8_t *response);
+
+	uint16_t _registers[MAX_PACKS][MODBUS_PACK_REGISTERS] = {};
+	uint8_t _packCount = 0;
+	bool _started = false;
+	portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+// request bytes of one client, buffered until a complete frame has arrived
+class ModbusConnection
+{
+public:
+	// answers every complete frame through write(response, length), TCP may split a frame or carry several,
+	// returns false on an invalid MBAP length, the stream cannot be resynchronised and the client is closed
+	template <typename Write>
+	bool Receive(ModbusServer &server, const uint8_t *data, size_t length, Write write)
+	{
+		while (length > 0)
+		{
+			size_t chunk = std::min<size_t>(length, MODBUS_MAX_FRAME - _length);
+			memcpy(&_buffer[_length], data, chunk);
+			_length += chunk;
+			data += chunk;
+			length -= chunk;
+			while (_length >= MBAP_SIZE)
+			{
+				size_t frameLength = FrameLength();
+				if (frameLength > MODBUS_MAX_FRAME || frameLength < MBAP_SIZE + 1)
+				{
+					return false;
+				}
+				if (_length < frameLength)
+				{
+					break;
+				}
+				uint8_t response[MODBUS_MAX_FRAME];
+				size_t responseLength = server.HandleRequest(_buffer, frameLength, response);
+				if (responseLength > 0)
+				{
+					write(response, responseLength);
+				}
+				_length -= frameLength;
+				memmove(_buffer, &_buffer[frameLength], _length);
+			}
+		}
+		return true;
+	}
+
+	// MBAP header and PDU of the buffered frame, from the MBAP length field
+	size_t FrameLength() const { return 6 + ((_buffer[4] << 8) | _buffer[5]); };
+
+private:
+	uint8_t _buffer[MODBUS_MAX_FRAME];
+	size_t _length = 0;
+};
+
+} // namespace PylonToMQTT
@@ -0,0 +1,54 @@
+#pragma once
+#include <Arduino.h>
+#include <deque>
+#include <string>
+#include "Defines.h"
+
+namespace PylonToMQTT
+{
+
+// drain order, highest first
+enum PublishPriority : uint8_t
+{
+	AlarmPriority,
+	DiscoveryPriority, // home assistant discovery and pack info
+	ReadingsPriority,
+	LogPriority, // diag, benchmark and status
+	PublishPriorityCount
+};
+
+const char *const PublishPriorityNames[] = {"alarm", "discovery", "readings", "log"};
+
+struct QueuedMessage
+{
+	std::string Topic;
+	std::string Payload;
+	bool Retained;
+	PublishPriority Priority;
+	uint32_t SampleMillis; // Clock::Millis() at the EOI of the readings, 0 when the data age is not tracked
+	uint8_t Bank; // whose data age SampleMillis counts towards
+};
+
+// Bounded outbound queue in front of the MQTT client, not thread safe, IOT serialises access.
+// A reading replaces a queued reading for the same topic, when full readings are evicted first and alarms only by newer alarms.
+class MqttQueue
+{
+public:
+	MqttQueue() {};
+
+	bool Push(PublishPriority priority, const char *topic, const char *payload, bool retained, uint32_t sampleMillis = 0, uint8_t bank = 0);
+	QueuedMessage *Peek();
+	void Pop();
+
+	size_t Depth() { return _count; };
+	size_t Bytes() { return _bytes; };
+
+private:
+	bool evict(PublishPriority priority);
+
+	std::deque<QueuedMessage> _queues[PublishPriorityCount];
+	size_t _count = 0;
+	size_t _bytes = 0;
+};
+
+} // namespace PylonToMQTT
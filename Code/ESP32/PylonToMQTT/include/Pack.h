@@ -2,7 +2,6 @@
 #include "Arduino.h"
 #include "ArduinoJson.h"
 #include <vector>
-#include "IOTCallbackInterface.h"
 #include "IOTServiceInterface.h"
 
 using namespace std;
@@ -20,23 +19,47 @@ class Pack {
       return _barCode;
     }
 
-    void setBarcode(const std::string& bc) {
+    std::string getVersionInfo() {
+      return _versionInfo;
+    }
+    int getNumberOfCells() {
+      return _numberOfCells;
+    }
+    int getNumberOfTemps() {
+      return _numberOfTemps;
+    }
+    bool HasInfo() {
+      return !_barCode.empty() || !_versionInfo.empty();
+    }
+
+    // setters return true when the value differs from the one already known (cached topology)
+    bool setBarcode(const std::string& bc) {
+      bool changed = _barCode != bc;
       _barCode = bc;
+      return changed;
     }
 
-    void setVersionInfo(const std::string& ver) {
+    bool setVersionInfo(const std::string& ver) {
+      bool changed = _versionInfo != ver;
       _versionInfo = ver;
+      return changed;
     }
 
-    void setNumberOfCells(int val) {
+    bool setNumberOfCells(int val) {
+      bool changed = _numberOfCells != val;
       _numberOfCells = val;
+      return changed;
     }
 
-    void setNumberOfTemps(int val) {
+    bool setNumberOfTemps(int val) {
+      bool changed = _numberOfTemps != val;
       _numberOfTemps = val;
+      return changed;
     }
- 
-    void PublishDiscovery();
+
+    void PublishInfo();
+    void PublishDiscovery(bool bankMessage = false, bool compactStatus = false);
+    void PublishAvailability(bool online);
 
     bool InfoPublished() {
         return _infoPublised;
@@ -44,8 +67,10 @@ class Pack {
     void SetInfoPublished() {
       _infoPublised = true;
     }
+    void SetDiscoveryPublished() {
+      _discoveryPublished = true;
+    }
 
-protected:
     bool ReadyToPublish() {
         return (!_discoveryPublished && InfoPublished() && _numberOfTemps > 0 && _numberOfCells > 0);
     }
@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "Defines.h"
+
+namespace PylonToMQTT
+{
+
+enum StatusRegister : uint8_t
+{
+    ProtectStatus1,
+    ProtectStatus2,
+    SystemStatus,
+    FaultStatus,
+    AlarmStatus1,
+    AlarmStatus2,
+    StatusRegisterCount
+};
+
+// latest readings of every pack in a bank as one array per field, in the raw units of the protocol
+// the decoders write a pack's slot in the bus task's copy, everyone else reads torn-free copies, see Pylon::ReadBank
+// consumers walking a field across the bank (metrics, dashboard, modbus) read contiguous memory
+struct BankReadings
+{
+    uint8_t PackCount;
+    uint8_t NumberOfCells[MAX_PACKS];
+    uint8_t NumberOfTemps[MAX_PACKS];
+    uint16_t VoltageMillivolts[MAX_PACKS];
+    int16_t CurrentCentiamps[MAX_PACKS];
+    uint16_t RemainingCentiamphours[MAX_PACKS];
+    uint16_t FullCentiamphours[MAX_PACKS];
+    uint16_t CycleCount[MAX_PACKS];
+    uint8_t CurrentState[MAX_PACKS];
+    uint8_t VoltageState[MAX_PACKS];
+    uint8_t Status[MAX_PACKS][StatusRegisterCount]; // AlarmInfo bitfields, see StatusBits.h
+    uint16_t CellMillivolts[MAX_PACKS][MAX_CELLS];
+    uint8_t CellStates[MAX_PACKS][MAX_CELLS];
+    uint16_t TempDeciKelvin[MAX_PACKS][MAX_TEMPS]; // 2730 = 0°C
+    uint8_t TempStates[MAX_PACKS][MAX_TEMPS];
+    uint32_t SampleMillis[MAX_PACKS];      // Clock::Millis() at the EOI of the pack's latest analog or alarm frame
+    uint64_t SampleEpochMillis[MAX_PACKS]; // NTP time of the same frame, 0 when the clock was not synced
+
+    uint8_t SOC(uint8_t pack) const
+    {
+        return FullCentiamphours[pack] == 0 ? 0 : ((uint32_t)RemainingCentiamphours[pack] * 100) / FullCentiamphours[pack];
+    }
+};
+
+enum ReadingsSection : uint8_t
+{
+    AnalogSection = 0x01, // AnalogValueFixedPoint received
+    AlarmSection = 0x02   // AlarmInfo received
+};
+
+// info/PackN, discovery and availability/PackN publishes the bus engine hands to the publisher
+enum TopologyMessage : uint8_t
+{
+    NoTopology,
+    InfoMessage,
+    DiscoveryMessage, // also availability/PackN Online
+    OfflineMessage    // availability/PackN Offline, the pack left the bank
+};
+
+// a pack whose readings were written to the bank's Seqlock, handed from the bus engine to the publisher, or an end of sequence marker
+// the publisher takes the values from its copy of the bank, only an event carries the status edge it reports
+// and a topology message the pack's info, the bus engine's Pack objects are not shared with the publisher
+struct PackSnapshot
+{
+    uint8_t Pack;          // index within the bank
+    uint8_t PackCount;
+    uint8_t Sections;      // ReadingsSection bits received for this pack, 0 for a marker
+    bool SequenceComplete; // all packs of the bank have been polled
+    uint8_t Poll;          // CommandInformation of an on-demand poll, 0 for the bus cycle
+    char PollId[POLL_ID_LEN];
+    bool Event;            // alarm bits changed from PreviousStatus to Status
+    uint8_t PreviousStatus[StatusRegisterCount];
+    uint8_t Status[StatusRegisterCount];
+    uint64_t SampleEpochMillis; // of the AlarmInfo frame that raised the event
+    uint8_t Topology;           // TopologyMessage to publish for the pack
+    char Version[VERSION_INFO_LEN];
+    char BarCode[BAR_CODE_LEN];
+    uint8_t Cells;
+    uint8_t Temps;
+};
+
+} // namespace PylonToMQTT
@@ -1,29 +1,24 @@
 #pragma once
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <Preferences.h>
+#include <atomic>
 #include "IOTServiceInterface.h"
-#include "AsyncSerial.h"
-#include "Pack.h"
+#include "IOTCallbackInterface.h"
+#include "BusEngine.h"
+#include "Metrics.h"
 #include "Defines.h"
 
 namespace PylonToMQTT
 {
-
-    class Pylon : public AsyncSerialCallbackInterface, public IOTCallbackInterface
+    class Pylon : public BusEngine, public IOTCallbackInterface
     {
 
     public:
-        Pylon();
-        ~Pylon();
-        void begin(IOTServiceInterface *pcb)
-        {
-            _psi = pcb;
-            _asyncSerial->begin(this, BAUDRATE, SERIAL_8N1, RXPIN, TXPIN);
-        };
+        Pylon() {};
+        void begin(IOTServiceInterface *pcb, uint8_t bank, HardwareSerial *serial, int8_t rxPin, int8_t txPin);
         void Process();
-        void Receive(int timeOut) { _asyncSerial->Receive(timeOut); };
-        bool Transmit();
-        int ParseResponse(char *szResponse, size_t readNow, CommandInformation cmd);
+        void Publish();
 
         // IOTCallbackInterface
         String getSettingsHTML();
@@ -33,40 +28,41 @@ namespace PylonToMQTT
 		void onMqttMessage(char* topic, JsonDocument& doc);
 		void onWiFiConnect();
 
-        // AsyncSerialCallbackInterface
-        void complete()
-        {
-            ParseResponse((char *)_asyncSerial->GetContent(), _asyncSerial->GetContentLength(), _asyncSerial->GetToken());
-        };
-        void overflow()
-        {
-            loge("AsyncSerial: overflow");
-        };
-        void timeout()
-        {
-            loge("AsyncSerial: timeout");
-        };
-
     protected:
-        JsonDocument _root;
-        uint8_t _infoCommandIndex = 0;
-        uint8_t _readingsCommandIndex = 0;
-        uint8_t _numberOfPacks = 0;
-        uint8_t _currentPack = 0;
-        AsyncSerial *_asyncSerial;
-        IOTServiceInterface *_psi;
-        CommandInformation _currentCommand = CommandInformation::None;
+        void notifyPublisher();
+        void saveTopology();
 
-        uint16_t get_frame_checksum(char *frame);
-        int get_info_length(const char *info);
-        void encode_cmd(char *frame, uint8_t address, uint8_t cid2, const char *info);
         String convert_ASCII(char *p);
         int parseValue(char **pp, int l);
-        void send_cmd(uint8_t address, CommandInformation cmd);
+        void loadTopology();
+        String topologyNamespace();
+        void publishTopology(const PackSnapshot &snapshot);
+        void publishReadings(const PackSnapshot &snapshot);
+        void publishBank();
+        void publishPoll(const PackSnapshot &snapshot);
+        bool requestCapture(int pack, int seconds);
+        void publishCapture();
+        void publishEvent(const PackSnapshot &snapshot);
+
+        Preferences _preferences;
+        unsigned long _lastDiagTimeStamp = 0;
+        int _benchmarkIterations = 0; // requested on cmnd/benchmark
+        std::atomic<bool> _benchmarkRunning{false};
+        static void benchmarkTask(void *arg);
+        TaskHandle_t _task = NULL;
+        static void task(void *arg);
 
-    private:
-        std::vector<Pack> _Packs;
-        std::vector<string> _TempKeys;
+        // network core side
+        TaskHandle_t _publishTask = NULL;
+        static void publishTask(void *arg);
+        BankReadings _view = {}; // read from _bankReadings for the web pages, modbus and metrics
+        bool _bankMessage = false; // gather a bank cycle into stat/readings/bank instead of stat/readings/PackN
+        bool _compactStatus = false; // status bytes as integers, the decoded groups only when they change
+        uint8_t _lastStatus[MAX_PACKS][StatusRegisterCount] = {};
+        uint8_t _statusKnown = 0; // bit per pack with a published status
+        JsonDocument _bankDoc;
+        uint32_t _bankSequence = 0;
+        uint32_t _bankSampleMillis = 0; // oldest sample in _bankDoc
     };
 } // namespace PylonToMQTT
 
@@ -0,0 +1,17 @@
+#pragma once
+#include <ArduinoJson.h>
+#include <string>
+#include <vector>
+#include "PackReadings.h"
+
+namespace PylonToMQTT
+{
+
+// the readings/PackN payload of one pack of the bank, with the ReadingsSection bits in sections,
+// in compact mode the status bytes are always included and the decoded groups only with decodeStatus
+void BuildReadings(JsonObject doc, const BankReadings &readings, uint8_t pack, uint8_t sections, const std::vector<std::string> &tempKeys, bool compactStatus, bool decodeStatus = true);
+
+// the decoded Protect_Status, System_Status, Fault_Status and Alarm_Status groups of the status registers
+void AddStatusGroups(JsonObject doc, const uint8_t *status);
+
+} // namespace PylonToMQTT
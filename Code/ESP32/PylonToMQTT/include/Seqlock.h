@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+namespace PylonToMQTT
+{
+
+// Versioned value with one writer and any number of readers on either core.
+// The writer never waits, a reader copies the value and retries only if a write overlapped the copy.
+template <typename T>
+class Seqlock
+{
+public:
+	Seqlock() { memset(&_value, 0, sizeof(T)); };
+
+	void Write(const T &value)
+	{
+		uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+		_sequence.store(sequence + 1, std::memory_order_relaxed); // odd while writing
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(&_value, &value, sizeof(T));
+		_sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	// returns the version of the copy, 0 until the first write
+	uint32_t Read(T &value) const
+	{
+		uint32_t before;
+		uint32_t after;
+		do
+		{
+			before = _sequence.load(std::memory_order_acquire);
+			memcpy(&value, &_value, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = _sequence.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+		return before / 2;
+	}
+
+	uint32_t Version() const { return _sequence.load(std::memory_order_acquire) / 2; };
+
+private:
+	T _value;
+	std::atomic<uint32_t> _sequence{0};
+};
+
+} // namespace PylonToMQTT
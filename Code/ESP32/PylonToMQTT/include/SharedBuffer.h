@@ -0,0 +1,54 @@
+#pragma once
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+namespace PylonToMQTT
+{
+
+// Text rebuilt by the polling loop and served from the async web server task.
+// The writer fills Edit() and then calls Commit(), readers hold on to Get() for as long as they stream it.
+// The back buffer is reused unless a slow client is still streaming it.
+class SharedBuffer
+{
+public:
+	SharedBuffer() : _front(std::make_shared<std::string>()), _back(std::make_shared<std::string>()) {};
+
+	std::string &Edit()
+	{
+		if (_back.use_count() > 1) // readers can only take the front buffer, so this can only drop
+		{
+			_back = std::make_shared<std::string>();
+		}
+		_back->clear();
+		return *_back;
+	}
+
+	void Commit()
+	{
+		portENTER_CRITICAL(&_mux);
+		std::swap(_front, _back);
+		_version++;
+		portEXIT_CRITICAL(&_mux);
+	}
+
+	std::shared_ptr<const std::string> Get(uint32_t *version = nullptr)
+	{
+		portENTER_CRITICAL(&_mux);
+		std::shared_ptr<const std::string> front = _front;
+		if (version != nullptr)
+		{
+			*version = _version;
+		}
+		portEXIT_CRITICAL(&_mux);
+		return front;
+	}
+
+private:
+	std::shared_ptr<std::string> _front;
+	std::shared_ptr<std::string> _back;
+	uint32_t _version = 0;
+	portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+} // namespace PylonToMQTT
@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+
+namespace PylonToMQTT
+{
+
+// Lock-free ring of fixed size records between exactly one producer task and one consumer task.
+// Push() fails rather than blocks when the consumer falls behind, Size must be a power of two.
+template <typename T, size_t Size>
+class SpscQueue
+{
+	static_assert((Size & (Size - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+	SpscQueue() {};
+
+	bool Push(const T &item)
+	{
+		size_t head = _head.load(std::memory_order_relaxed);
+		if (head - _tail.load(std::memory_order_acquire) == Size)
+		{
+			return false; // full
+		}
+		_items[head & (Size - 1)] = item;
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T &item)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail == _head.load(std::memory_order_acquire))
+		{
+			return false; // empty
+		}
+		item = _items[tail & (Size - 1)];
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T _items[Size];
+	std::atomic<size_t> _head{0};
+	std::atomic<size_t> _tail{0};
+};
+
+} // namespace PylonToMQTT
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "PackReadings.h"
+
+namespace PylonToMQTT
+{
+
+// names of the AlarmInfo status bits, in the order they appear in the readings payload
+struct StatusBit
+{
+    const char *Group;
+    const char *Name;
+    StatusRegister Register;
+    uint8_t Bit;
+};
+
+const StatusBit StatusBits[] = {
+    {"Protect_Status", "Charger_OVP", ProtectStatus1, 7},
+    {"Protect_Status", "SCP", ProtectStatus1, 6},
+    {"Protect_Status", "DSG_OCP", ProtectStatus1, 5},
+    {"Protect_Status", "CHG_OCP", ProtectStatus1, 4},
+    {"Protect_Status", "Pack_UVP", ProtectStatus1, 3},
+    {"Protect_Status", "Pack_OVP", ProtectStatus1, 2},
+    {"Protect_Status", "Cell_UVP", ProtectStatus1, 1},
+    {"Protect_Status", "Cell_OVP", ProtectStatus1, 0},
+    {"Protect_Status", "ENV_UTP", ProtectStatus2, 6},
+    {"Protect_Status", "ENV_OTP", ProtectStatus2, 5},
+    {"Protect_Status", "MOS_OTP", ProtectStatus2, 4},
+    {"Protect_Status", "DSG_UTP", ProtectStatus2, 3},
+    {"Protect_Status", "CHG_UTP", ProtectStatus2, 2},
+    {"Protect_Status", "DSG_OTP", ProtectStatus2, 1},
+    {"Protect_Status", "CHG_OTP", ProtectStatus2, 0},
+
+    {"System_Status", "Fully_Charged", ProtectStatus2, 7},
+    {"System_Status", "Heater", SystemStatus, 7},
+    {"System_Status", "AC_in", SystemStatus, 5},
+    {"System_Status", "Discharge_MOS", SystemStatus, 2},
+    {"System_Status", "Charge_MOS", SystemStatus, 1},
+    {"System_Status", "Charge_Limit", SystemStatus, 0},
+
+    {"Fault_Status", "Heater_Fault", FaultStatus, 7},
+    {"Fault_Status", "CCB_Fault", FaultStatus, 6},
+    {"Fault_Status", "Sampling_Fault", FaultStatus, 5},
+    {"Fault_Status", "Cell_Fault", FaultStatus, 4},
+    {"Fault_Status", "NTC_Fault", FaultStatus, 2},
+    {"Fault_Status", "DSG_MOS_Fault", FaultStatus, 1},
+    {"Fault_Status", "CHG_MOS_Fault", FaultStatus, 0},
+
+    {"Alarm_Status", "DSG_OC", AlarmStatus1, 5},
+    {"Alarm_Status", "CHG_OC", AlarmStatus1, 4},
+    {"Alarm_Status", "Pack_UV", AlarmStatus1, 3},
+    {"Alarm_Status", "Pack_OV", AlarmStatus1, 2},
+    {"Alarm_Status", "Cell_UV", AlarmStatus1, 1},
+    {"Alarm_Status", "Cell_OV", AlarmStatus1, 0},
+    {"Alarm_Status", "SOC_Low", AlarmStatus2, 7},
+    {"Alarm_Status", "MOS_OT", AlarmStatus2, 6},
+    {"Alarm_Status", "ENV_UT", AlarmStatus2, 5},
+    {"Alarm_Status", "ENV_OT", AlarmStatus2, 4},
+    {"Alarm_Status", "DSG_UT", AlarmStatus2, 3},
+    {"Alarm_Status", "CHG_UT", AlarmStatus2, 2},
+    {"Alarm_Status", "DSG_OT", AlarmStatus2, 1},
+    {"Alarm_Status", "CHG_OT", AlarmStatus2, 0},
+};
+
+#define STATUS_BIT_COUNT (sizeof(StatusBits) / sizeof(StatusBit))
+
+// protect, fault and alarm bits raise an event on either edge, system status bits follow normal operation
+inline bool IsAlarmBit(const StatusBit &sb)
+{
+    return strcmp(sb.Group, "System_Status") != 0;
+}
+
+} // namespace PylonToMQTT
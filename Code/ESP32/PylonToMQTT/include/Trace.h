@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <string>
+#include "TraceEvents.h"
+
+#define TRACE_RING_SIZE 256 // records, power of 2
+#define TRACE_MAX_ARGS 4
+
+#define logt(event, ...) _trace.Record(TRACE_##event, ##__VA_ARGS__)
+
+enum TraceEvent : uint16_t
+{
+#define TRACE_EVENT_ID(name, format) TRACE_##name,
+	TRACE_EVENTS(TRACE_EVENT_ID)
+#undef TRACE_EVENT_ID
+	TraceEventCount
+};
+
+// binary layout served on /trace, little endian, 28 bytes per record
+struct TraceRecord
+{
+	uint32_t Sequence;
+	uint32_t Timestamp; // micros()
+	uint16_t Event;
+	uint8_t ArgCount;
+	uint8_t Reserved;
+	uint32_t Args[TRACE_MAX_ARGS];
+};
+
+// Lock free ring of trace records, any task can record, the web log task is the only reader.
+// Only the event id and raw arguments are stored, formatting is deferred.
+class Trace
+{
+public:
+	Trace() {};
+
+	template <typename... T>
+	void Record(TraceEvent event, T... args)
+	{
+		static_assert(sizeof...(T) <= TRACE_MAX_ARGS, "too many trace arguments");
+		uint32_t values[] = {0, (uint32_t)args...};
+		write(event, &values[1], sizeof...(T));
+	}
+
+	size_t Format(char *buffer, size_t size);
+	void Snapshot(std::string &out);
+
+private:
+	void write(TraceEvent event, const uint32_t *args, uint8_t count);
+
+	struct Slot
+	{
+		std::atomic<uint32_t> Sequence{0}; // 0 while being written
+		TraceRecord Record;
+	};
+	Slot _slots[TRACE_RING_SIZE];
+	std::atomic<uint32_t> _head{0}; // sequence of the last record claimed
+	uint32_t _tail = 0;				// sequence of the last record formatted
+};
+
+extern Trace _trace;
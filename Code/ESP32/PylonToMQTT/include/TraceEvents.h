@@ -0,0 +1,15 @@
+#pragma once
+
+// Trace events, X(name, format). Formats take only integer arguments (at most 4), they are applied
+// when the web log is open or offline by tools/trace_decode.py, which parses this file.
+// Append new events at the end so recorded ids keep decoding.
+#define TRACE_EVENTS(X)                                                  \
+    X(SEND_CMD, "send_cmd: ADR: %02X, CID2: %02X")                       \
+    X(FRAME, "VER: %02X, ADR: %02X, CID2: %02X, LENID: %d")              \
+    X(ANALOG_VALUE, "AnalogValueFixedPoint: INFO: %04X, Pack: %d")       \
+    X(ALARM_INFO, "GetAlarm: Pack: %d")                                  \
+    X(PUBLISH_READINGS, "Published readings for Pack%d, %d bytes")
+
+// pack argument of PUBLISH_READINGS for a readings/bank message, formatted with TRACE_BANK_FORMAT and the remaining arguments
+#define TRACE_BANK 0xFF
+#define TRACE_BANK_FORMAT "Published readings for bank, %d bytes"
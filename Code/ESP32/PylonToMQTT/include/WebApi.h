@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "Defines.h"
+#include "SharedBuffer.h"
+
+namespace PylonToMQTT
+{
+
+// JSON snapshot of the latest readings on /api/readings and /api/packs/{n}
+class WebApi
+{
+public:
+	WebApi() {};
+	void begin(AsyncWebServer *pwebServer);
+	void UpdatePack(int packIndex, const String &json);
+	void Commit(int packCount);
+
+private:
+	void send(AsyncWebServerRequest *request, SharedBuffer &buffer);
+
+	SharedBuffer _readings;
+	SharedBuffer _packs[MAX_PACKS];
+	int _packCount = 0;
+	bool _dirty = false;
+	bool _started = false;
+	uint32_t _etagBase = 0; // distinguishes versions across reboots
+};
+
+} // namespace PylonToMQTT
@@ -0,0 +1,46 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <WebSocketsServer.h>
+#include "Defines.h"
+#include "PackReadings.h"
+
+// Binary frames pushed on the home page socket, all values little endian.
+// header: type ('K' keyframe, 'D' delta), pack count, sequence (uint16)
+// keyframe: DASHBOARD_PACK_WORDS words per pack
+// delta: change bitmap (1 bit per word), followed by the changed words in order
+//
+// words per pack:
+//  0 PackVoltage mV, 1 PackCurrent cA (signed), 2 SOC %, 3 RemainingCapacity cAh, 4 FullCapacity cAh, 5 CycleCount
+//  6 cells | temps << 8, 7 current state | voltage state << 8
+//  8 ProtectSts1 | ProtectSts2 << 8, 9 SystemSts | FaultSts << 8, 10 AlarmSts1 | AlarmSts2 << 8
+//  11..26 cell mV, 27..32 temperature dK, 33..40 cell states (2 per word), 41..43 temperature states (2 per word)
+#define DASHBOARD_PACK_WORDS 44
+#define DASHBOARD_FRAME_WORDS (MAX_PACKS * DASHBOARD_PACK_WORDS)
+#define DASHBOARD_HEADER_SIZE 4
+
+namespace PylonToMQTT
+{
+
+class WebDashboard
+{
+public:
+	WebDashboard() {};
+	void begin();
+	void process();
+	void Update(const BankReadings &readings);
+
+private:
+	void encodePack(uint16_t *words, const BankReadings &readings, uint8_t pack);
+	size_t encodeKeyframe();
+	size_t encodeDelta(size_t wordCount);
+
+	uint16_t _frame[DASHBOARD_FRAME_WORDS] = {}; // latest readings
+	uint16_t _sent[DASHBOARD_FRAME_WORDS] = {};	 // state of the connected clients
+	uint8_t _buffer[DASHBOARD_HEADER_SIZE + DASHBOARD_FRAME_WORDS / 8 + DASHBOARD_FRAME_WORDS * 2];
+	uint8_t _packCount = 0;
+	uint16_t _sequence = 0;
+	bool _started = false;
+};
+
+} // namespace PylonToMQTT
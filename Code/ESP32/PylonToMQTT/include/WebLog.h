@@ -6,6 +6,13 @@
 #include "defines.h"
 #include <WebSocketsServer.h>
 #include <ESPAsyncWebServer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/ringbuf.h"
+
+#define LOG_RING_SIZE 8192 // bytes of pending log text
+#define LOG_LINE_SIZE 256 // longer lines are truncated
+#define LOG_BATCH_SIZE 1400 // bytes per WebSocket frame
+#define LOG_FLUSH_INTERVAL 50 // ms between batches
 
 // Store HTML content with JavaScript to receive serial log data via WebSocket
 const char web_serial_html[] PROGMEM = R"rawliteral(
@@ -49,7 +56,8 @@ class WebLog
 public:
 	WebLog() {};
 	void begin(AsyncWebServer *pwebServer);
-	void process();
 
 private:
+	static void task(void *arg);
+	TaskHandle_t _task = NULL;
 };
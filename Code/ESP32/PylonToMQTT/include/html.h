@@ -6,17 +6,111 @@ const char home_html[] PROGMEM = R"rawliteral(
 	<!DOCTYPE html><html lang=\"en\">
 	<head><meta name=\"viewport\" content=\"width=device-width, initial-scale=1, user-scalable=no\"/>
 	<title>{n}</title>
+	<style>
+		.pack { border: 1px solid #ccc; margin: 8px 0; padding: 6px; font-family: sans-serif; font-size: .8em; }
+		.cell { display: flex; align-items: center; margin: 1px 0; }
+		.cell span { width: 90px; }
+		.bar { height: 10px; background: #4caf50; }
+		.bar.low { background: #2196f3; }
+		.bar.high { background: #ff9800; }
+		.bar.alarm { background: #f44336; }
+		.alarm { color: #f44336; }
+	</style>
+	<script>
+		const W = 44; // words per pack, see WebDashboard.h
+		const PROTECT1 = ['Cell_OVP', 'Cell_UVP', 'Pack_OVP', 'Pack_UVP', 'CHG_OCP', 'DSG_OCP', 'SCP', 'Charger_OVP'];
+		const PROTECT2 = ['CHG_OTP', 'DSG_OTP', 'CHG_UTP', 'DSG_UTP', 'MOS_OTP', 'ENV_OTP', 'ENV_UTP', 'Fully_Charged'];
+		const SYSTEM = ['Charge_Limit', 'Charge_MOS', 'Discharge_MOS', '', '', 'AC_in', '', 'Heater'];
+		const FAULT = ['CHG_MOS_Fault', 'DSG_MOS_Fault', 'NTC_Fault', '', 'Cell_Fault', 'Sampling_Fault', 'CCB_Fault', 'Heater_Fault'];
+		const ALARM1 = ['Cell_OV', 'Cell_UV', 'Pack_OV', 'Pack_UV', 'CHG_OC', 'DSG_OC', '', ''];
+		const ALARM2 = ['CHG_OT', 'DSG_OT', 'CHG_UT', 'DSG_UT', 'ENV_OT', 'ENV_UT', 'MOS_OT', 'SOC_Low'];
+		let words = null;
+		let packs = 0;
 
+		function flags(v, names) {
+			let r = [];
+			for (let b = 0; b < 8; b++) {
+				if (names[b] && ((v >> b) & 1)) r.push(names[b]);
+			}
+			return r;
+		}
+
+		function decode(data) {
+			const d = new DataView(data);
+			const type = String.fromCharCode(d.getUint8(0));
+			packs = d.getUint8(1);
+			const count = packs * W;
+			let o = 4;
+			if (type == 'K') {
+				words = new Uint16Array(count);
+				for (let i = 0; i < count; i++, o += 2) words[i] = d.getUint16(o, true);
+			} else if (words && words.length == count) {
+				const bitmap = o;
+				o += Math.ceil(count / 8);
+				for (let i = 0; i < count; i++) {
+					if (d.getUint8(bitmap + (i >> 3)) & (1 << (i & 7))) {
+						words[i] = d.getUint16(o, true);
+						o += 2;
+					}
+				}
+			}
+		}
+
+		function render() {
+			let h = '';
+			for (let p = 0; p < packs; p++) {
+				const w = words.subarray(p * W, (p + 1) * W);
+				const cells = w[6] & 0xFF, temps = w[6] >> 8;
+				const current = ((w[1] << 16) >> 16) / 100;
+				const mv = Array.from(w.subarray(11, 11 + cells));
+				const min = Math.min(...mv), max = Math.max(...mv);
+				h += '<div class="pack"><b>Pack' + (p + 1) + '</b> ' + (w[0] / 1000).toFixed(3) + ' V ' + current.toFixed(2) + ' A SOC ' + w[2] + '% ';
+				h += (w[3] / 100).toFixed(2) + '/' + (w[4] / 100).toFixed(2) + ' Ah cycles ' + w[5] + ' &Delta;' + (max - min) + ' mV';
+				for (let c = 0; c < cells; c++) {
+					const state = (w[33 + (c >> 1)] >> ((c & 1) * 8)) & 0xFF;
+					const pct = Math.max(0, Math.min(100, (mv[c] - 2800) / 8.5));
+					const cls = (state == 1 || state == 2) ? 'alarm' : (mv[c] == max && max != min) ? 'high' : (mv[c] == min && max != min) ? 'low' : '';
+					h += '<div class="cell"><span>Cell_' + (c + 1) + ' ' + (mv[c] / 1000).toFixed(3) + '</span><div class="bar ' + cls + '" style="width:' + pct * 3 + 'px"></div></div>';
+				}
+				let t = [];
+				for (let i = 0; i < temps; i++) {
+					const state = (w[41 + (i >> 1)] >> ((i & 1) * 8)) & 0xFF;
+					t.push('<span' + (state == 1 || state == 2 ? ' class="alarm"' : '') + '>' + ((w[27 + i] - 2730) / 10).toFixed(1) + '&deg;C</span>');
+				}
+				h += '<div>' + t.join(' ') + '</div>';
+				const status = flags(w[9] & 0xFF, SYSTEM).concat((w[8] & 0x8000) ? ['Fully_Charged'] : []);
+				const alarms = flags(w[8] & 0xFF, PROTECT1).concat(flags((w[8] >> 8) & 0x7F, PROTECT2), flags(w[9] >> 8, FAULT), flags(w[10] & 0xFF, ALARM1), flags(w[10] >> 8, ALARM2));
+				h += '<div>' + status.join(' ') + '</div><div class="alarm">' + alarms.join(' ') + '</div></div>';
+			}
+			document.getElementById('packs').innerHTML = h;
+		}
+
+		function initWebSocket() {
+			const socket = new WebSocket('ws://' + window.location.hostname + ':{hp}');
+			socket.binaryType = 'arraybuffer';
+			socket.onmessage = function(event) {
+				decode(event.data);
+				if (words) render();
+			};
+			socket.onclose = function() {
+				words = null;
+				setTimeout(initWebSocket, 5000);
+			};
+		}
+		window.onload = function() {
+			initWebSocket();
+		}
+	</script>
 	</head>
-	
+
 	<body>
 	<h2>{n}</h2>
 	<div style='font-size: .6em;'>Firmware config version '{v}'</div>
 	<hr>
-	
+	<div id='packs'></div>
 	<p>
 	<div style='padding-top:25px;'>
 	<p><a href='settings' onclick="javascript:event.target.port={cp}" >View Current Settings</a></p>
-	
+
 	</div></body></html>
-	)rawliteral";
\ No newline at end of file
+	)rawliteral";
@@ -1,5 +1,6 @@
 #include "AsyncSerial.h"
 #include "Log.h"
+#include "Clock.h"
 
 #define BufferSize 2048
 
@@ -19,19 +20,17 @@ AsyncSerial::~AsyncSerial()
 	free(_buffer);
 }
 
-void AsyncSerial::begin(AsyncSerialCallbackInterface* cbi, unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin)
+void AsyncSerial::begin(AsyncSerialCallbackInterface* cbi, Stream* stream)
 {
 	_cbi = cbi;
-	Serial2.begin(baud, config, rxPin, txPin);
-	while (!Serial2) {}
-	_stream = &Serial2;
+	_stream = stream;
 }
 
 void AsyncSerial::Receive(int timeOut)
 {
 	if (_status != RECEIVING_DATA) { return; }
 	Timeout = timeOut;
-	_startTime = millis();
+	_startTime = _clock->Millis();
 	bool SOIfound = false;
 	while (_status < MESSAGE_RECEIVED)
 	{
@@ -43,12 +42,18 @@ void AsyncSerial::Receive(int timeOut)
 		}
 		if (_status == RECEIVING_DATA)
 		{
+			if (!_stream->available())
+			{
+				_clock->Delay(1); // the UART driver buffers the response while the task sleeps
+				continue;
+			}
 			while (_stream->available())
 			{
 				byte newData = _stream->read();
 				if (SOIfound) {
 					if (newData == (byte)EOIChar) {
 						_status = MESSAGE_RECEIVED;
+						_completeTime = _clock->Millis();
 						_buffer[_bufferIndex] = 0;
 						if (_cbi != nullptr) _cbi->complete(); // call service function to handle payload
 						break;
@@ -90,7 +95,7 @@ void AsyncSerial::Send(CommandInformation cmd, byte* data, size_t dataLength)
 inline bool AsyncSerial::IsExpired()
 {
 	if (Timeout == 0) return false;
-	return ((unsigned long)(millis() - _startTime) > Timeout);
+	return ((uint32_t)(_clock->Millis() - _startTime) > Timeout);
 }
 
 byte * AsyncSerial::GetContent()
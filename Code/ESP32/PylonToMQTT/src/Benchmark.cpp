@@ -0,0 +1,114 @@
+#include "Log.h"
+#include "Benchmark.h"
+#include "ReadingsJson.h"
+
+namespace PylonToMQTT
+{
+	// captured responses from a US2000C bank, see Docs/*.txt
+	const char _packCountFrame[] = "~25014600E00205FD32";
+	const char _analogValueFrame[] = "~25014600D07C0001100D200D240D240D210D210D220D230D240D220D210D220D220D230D220D230D21060B230B210B270B260B450B4E0050D22327CF0227D6000B271063E372";
+	const char _alarmInfoFrame[] = "~25014600E04E00011002020202010101000000000000000001060201010101020002020080A600000000000000EEA1";
+	const char _versionInfoFrame[] = "~25014600602850313653313030412D31423437302D312E303400F586";
+	const char _barCodeFrame[] = "~25014600B05031423437303130323137303939394420202020204D617220333020323032322C31383A31383A3136ED77";
+
+	void Benchmark::Run(int iterations, JsonDocument &results)
+	{
+		logi("Running benchmark, %d iterations per case", iterations);
+		results["iterations"] = iterations;
+		results["cpu_mhz"] = ESP.getCpuFreqMHz();
+		results["free_heap"] = ESP.getFreeHeap();
+		JsonObject parseResults = results["parse"].to<JsonObject>();
+		parse("GetPackCount", _packCountFrame, CommandInformation::GetPackCount, iterations, parseResults); // creates the scratch packs
+		parse("GetVersionInfo", _versionInfoFrame, CommandInformation::GetVersionInfo, iterations, parseResults);
+		parse("GetBarCode", _barCodeFrame, CommandInformation::GetBarCode, iterations, parseResults);
+		parse("AlarmInfo", _alarmInfoFrame, CommandInformation::AlarmInfo, iterations, parseResults);
+		parse("AnalogValueFixedPoint", _analogValueFrame, CommandInformation::AnalogValueFixedPoint, iterations, parseResults);
+
+		// full 16 cell readings document as published on readings/PackN, both parsed frames are for Pack1
+		uint8_t sections = AnalogSection | AlarmSection;
+		uint32_t start = micros();
+		for (int i = 0; i < iterations; i++)
+		{
+			JsonDocument doc;
+			BuildReadings(doc.to<JsonObject>(), _working, 0, sections, _TempKeys, false);
+		}
+		report(results["build"].to<JsonObject>(), iterations, micros() - start);
+		JsonDocument doc;
+		BuildReadings(doc.to<JsonObject>(), _working, 0, sections, _TempKeys, false);
+		size_t bytes = 0;
+		start = micros();
+		for (int i = 0; i < iterations; i++)
+		{
+			String s;
+			serializeJson(doc, s);
+			bytes = s.length();
+		}
+		JsonObject serializeResult = results["serialize"].to<JsonObject>();
+		report(serializeResult, iterations, micros() - start);
+		serializeResult["bytes"] = bytes;
+
+		// the same document with the status bytes as integers and no decoded groups
+		start = micros();
+		for (int i = 0; i < iterations; i++)
+		{
+			JsonDocument compact;
+			BuildReadings(compact.to<JsonObject>(), _working, 0, sections, _TempKeys, true, false);
+			String s;
+			serializeJson(compact, s);
+			bytes = s.length();
+		}
+		JsonObject compactResult = results["compact"].to<JsonObject>();
+		report(compactResult, iterations, micros() - start);
+		compactResult["bytes"] = bytes;
+
+		// home assistant discovery document of a 16 cell, 6 temperature pack
+		start = micros();
+		for (int i = 0; i < iterations; i++)
+		{
+			Pack pack("Pack1", &_TempKeys, this);
+			pack.setNumberOfCells(16);
+			pack.setNumberOfTemps(6);
+			pack.SetInfoPublished();
+			pack.PublishDiscovery();
+		}
+		JsonObject discoveryResult = results["discovery"].to<JsonObject>();
+		report(discoveryResult, iterations, micros() - start);
+		discoveryResult["bytes"] = _publishedBytes;
+
+		// send_cmd framing without the serial write
+		char raw_frame[64];
+		start = micros();
+		for (int i = 0; i < iterations; i++)
+		{
+			char bdevid[4];
+			sprintf(bdevid, "%02X", 1);
+			encode_cmd(raw_frame, 1, CommandInformation::AnalogValueFixedPoint, bdevid);
+		}
+		JsonObject encodeResult = results["encode"].to<JsonObject>();
+		report(encodeResult, iterations, micros() - start);
+		encodeResult["bytes"] = strlen(raw_frame);
+	}
+
+	void Benchmark::parse(const char *name, const char *frame, CommandInformation cmd, int iterations, JsonObject results)
+	{
+		char buf[sizeof(_analogValueFrame)];
+		strcpy(buf, frame);
+		size_t len = strlen(buf);
+		uint32_t start = micros();
+		for (int i = 0; i < iterations; i++)
+		{
+			ParseResponse(buf, len, cmd);
+		}
+		JsonObject result = results[name].to<JsonObject>();
+		report(result, iterations, micros() - start);
+		result["bytes"] = len;
+	}
+
+	void Benchmark::report(JsonObject result, int iterations, uint32_t elapsed)
+	{
+		result["total_us"] = elapsed;
+		result["us_per_op"] = elapsed / (float)iterations;
+		result["ops_per_sec"] = elapsed > 0 ? (uint32_t)((uint64_t)iterations * 1000000 / elapsed) : 0;
+	}
+
+} // namespace PylonToMQTT
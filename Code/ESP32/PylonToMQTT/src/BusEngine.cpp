@@ -0,0 +1,649 @@
+#include <Arduino.h>
+#include <vector>
+#include "Log.h"
+#include "Trace.h"
+#include "Defines.h"
+#include "BusEngine.h"
+#include "FrameReader.h"
+#include "FrameDecode.h"
+#include "Clock.h"
+#include "StatusBits.h"
+
+namespace PylonToMQTT
+{
+	CommandInformation _infoCommands[] = {CommandInformation::GetVersionInfo, CommandInformation::GetBarCode, CommandInformation::None};
+	CommandInformation _readingsCommands[] = {CommandInformation::AnalogValueFixedPoint, CommandInformation::AlarmInfo, CommandInformation::None};
+
+	BusEngine::BusEngine()
+	{
+		_asyncSerial = new AsyncSerial();
+		_TempKeys = {"CellTemp1_4", "CellTemp5_8", "CellTemp9_12", "CellTemp13_16", "MOS_T", "ENV_T"};
+	}
+
+	BusEngine::~BusEngine()
+	{
+		delete _asyncSerial;
+	}
+
+	void BusEngine::Start(Stream *serial)
+	{
+		_asyncSerial->begin(this, serial);
+		_schedule.Start(_clock->Millis());
+		_lastEnumerationTimeStamp = _clock->Millis();
+	}
+
+	// the serial receive blocks the calling task only so banks are read concurrently
+	// in low power mode the pass blocks until the next command is due, a poll from MQTT wakes it early
+	void BusEngine::Step(bool connected, uint32_t publishRate, bool lowPower)
+	{
+		unsigned long wait = 1;
+		if (connected)
+		{
+			Receive(SERIAL_RECEIVE_TIMEOUT);
+			if (!Poll() && _schedule.Due(_clock->Millis()))
+			{
+				bool sequenceComplete = Transmit();
+				_schedule.Sent(_clock->Millis(), sequenceComplete, publishRate);
+				if (sequenceComplete && lowPower)
+				{
+					_dutyCycle.CycleComplete(_clock->Millis());
+					_counters.AverageMilliamps = _dutyCycle.AverageMilliamps();
+					_counters.DutyPercent = _dutyCycle.DutyPercent();
+				}
+			}
+			if (lowPower && _asyncSerial->Idle())
+			{
+				wait = _schedule.IdleTime(_clock->Millis(), _alarmPacks != 0);
+			}
+		}
+		_dutyCycle.Asleep(_clock->Millis());
+		_clock->Wait(wait);
+		_dutyCycle.Awake(_clock->Millis());
+	}
+
+	bool BusEngine::Transmit()
+	{
+		bool sequenceComplete = false;
+		if (_numberOfPacks == 0)
+		{
+			send_cmd(0xFF, CommandInformation::GetPackCount);
+		}
+		else
+		{
+			if (_currentPack == 0 && _infoCommandIndex == 0 && _readingsCommandIndex == 0 && (sendValidationCommand() || sendEnumerationCommand()))
+			{
+				return sequenceComplete;
+			}
+			if (_currentPack < _Packs.size())
+			{
+				Pack &pack = _Packs[_currentPack];
+				if (pack.InfoPublished() == false && pack.HasInfo() && _infoCommandIndex == 0)
+				{
+					queueInfo(_currentPack); // restored from the topology cache, no need to query the pack
+					queueDiscovery(_currentPack);
+				}
+				if (pack.InfoPublished() == false)
+				{
+					if (_infoCommands[_infoCommandIndex] != CommandInformation::None)
+					{
+						send_cmd(_currentPack + 1, _infoCommands[_infoCommandIndex]);
+					}
+					else
+					{
+						if (pack.HasInfo())
+						{
+							queueInfo(_currentPack);
+						}
+					}
+					_infoCommandIndex++;
+					if (_infoCommandIndex == sizeof(_infoCommands))
+					{
+						_infoCommandIndex = 0;
+						_currentPack++;
+						if (_currentPack == _numberOfPacks)
+						{
+							_currentPack = 0;
+							sequenceComplete = true;
+						}
+					}
+				}
+				else
+				{
+					if (_readingsCommands[_readingsCommandIndex] != CommandInformation::None)
+					{
+						send_cmd(_currentPack + 1, _readingsCommands[_readingsCommandIndex]);
+					}
+					else
+					{
+						if (_sections != 0)
+						{
+							queueDiscovery(_currentPack); // if ready and not already published
+							PackSnapshot snapshot = {};
+							snapshot.Pack = _currentPack;
+							snapshot.PackCount = _Packs.size();
+							snapshot.Sections = _sections;
+							_working.PackCount = min<size_t>(_Packs.size(), MAX_PACKS);
+							_bankReadings.Write(_working);
+							queueSnapshot(snapshot);
+							_sections = 0;
+						}
+					}
+					_readingsCommandIndex++;
+					if (_readingsCommandIndex == sizeof(_readingsCommands))
+					{
+						_readingsCommandIndex = 0;
+						_currentPack++;
+						if (_currentPack == _numberOfPacks)
+						{
+							_currentPack = 0;
+							sequenceComplete = true;
+						}
+					}
+				}
+			}
+		}
+		if (sequenceComplete)
+		{
+			PackSnapshot marker = {};
+			marker.PackCount = _Packs.size();
+			marker.SequenceComplete = true;
+			queueSnapshot(marker);
+			_validationSent = false;
+			if (_topologyDirty)
+			{
+				saveTopology();
+			}
+		}
+		return sequenceComplete;
+	}
+
+	// sends a queued on-demand command at the head of the bus schedule, returns true while it is outstanding
+	bool BusEngine::Poll()
+	{
+		if (_pollSent)
+		{
+			_pollSent = false;
+			queuePollResult(); // response parsed or timed out in Receive
+			_sections = _scheduleSections;
+		}
+		if (_numberOfPacks == 0 || (!_polls.Pop(_poll) && !nextCapture(_poll) && !nextBurst(_poll)))
+		{
+			return false;
+		}
+		if (_poll.Pack > _Packs.size())
+		{
+			logw("Poll of Pack%d, bank has %d packs", _poll.Pack, _Packs.size());
+			queuePollResult();
+			return false;
+		}
+		_scheduleSections = _sections;
+		_sections = 0;
+		send_cmd(_poll.Pack, _poll.Command);
+		_pollSent = true;
+		return true;
+	}
+
+	void BusEngine::queuePollResult()
+	{
+		PackSnapshot snapshot = {};
+		snapshot.Pack = _poll.Pack - 1;
+		snapshot.PackCount = _Packs.size();
+		snapshot.Poll = _poll.Command;
+		strlcpy(snapshot.PollId, _poll.Id, sizeof(snapshot.PollId));
+		if (_poll.Pack <= _Packs.size())
+		{
+			snapshot.Sections = _sections;
+		}
+		if (snapshot.Sections != 0)
+		{
+			_working.PackCount = min<size_t>(_Packs.size(), MAX_PACKS);
+			_bankReadings.Write(_working);
+		}
+		if (_poll.Capture)
+		{
+			captureSample(snapshot);
+		}
+		else if (_poll.Id[0] != '\0') // burst polls only feed the alarm edge detection
+		{
+			queueSnapshot(snapshot);
+		}
+	}
+
+	// AnalogValueFixedPoint of the capture pack as fast as the bus answers, until the time is up or the buffer is full
+	bool BusEngine::nextCapture(PollRequest &request)
+	{
+		if (_captureReady)
+		{
+			return false; // the previous capture is still being published
+		}
+		if (!_capturing)
+		{
+			if (!_captures.Pop(_capture))
+			{
+				return false;
+			}
+			if (_capture.Pack > _Packs.size())
+			{
+				logw("Capture of Pack%d, bank has %d packs", _capture.Pack, _Packs.size());
+				return false;
+			}
+			_captureSamples.clear();
+			_captureSamples.reserve(CAPTURE_SAMPLES);
+			_captureMissed = 0;
+			_captureStart = _clock->Millis();
+			_captureEpochMillis = _clock->EpochMillis();
+			_capturing = true;
+			logi("Capturing Pack%d for %d seconds", _capture.Pack, _capture.Seconds);
+		}
+		else if (Clock::Elapsed(_clock->Millis(), _captureStart + _capture.Seconds * 1000))
+		{
+			endCapture();
+			return false;
+		}
+		request = {};
+		request.Pack = _capture.Pack;
+		request.Command = CommandInformation::AnalogValueFixedPoint;
+		request.Capture = true;
+		return true;
+	}
+
+	void BusEngine::captureSample(const PackSnapshot &snapshot)
+	{
+		if (!(snapshot.Sections & AnalogSection))
+		{
+			_captureMissed++;
+			return;
+		}
+		CaptureSample sample;
+		sample.Millis = _working.SampleMillis[snapshot.Pack] - _captureStart;
+		sample.VoltageMillivolts = _working.VoltageMillivolts[snapshot.Pack];
+		sample.CurrentCentiamps = _working.CurrentCentiamps[snapshot.Pack];
+		_captureSamples.push_back(sample);
+		if (_captureSamples.size() >= CAPTURE_SAMPLES)
+		{
+			endCapture();
+		}
+	}
+
+	void BusEngine::endCapture()
+	{
+		_capturing = false;
+		_captureReady = true;
+		notifyPublisher();
+	}
+
+	// AlarmInfo for the next pack with an active alarm, round robin at ALARM_BURST_RATE
+	bool BusEngine::nextBurst(PollRequest &request)
+	{
+		if (_alarmPacks == 0 || !_schedule.BurstDue(_clock->Millis()))
+		{
+			return false;
+		}
+		for (int i = 0; i < MAX_PACKS; i++)
+		{
+			_burstPack = (_burstPack + 1) % MAX_PACKS;
+			if (_alarmPacks & (1 << _burstPack))
+			{
+				break;
+			}
+		}
+		request = {};
+		request.Pack = _burstPack + 1;
+		request.Command = CommandInformation::AlarmInfo;
+		_schedule.Burst(_clock->Millis());
+		return true;
+	}
+
+	// queues an event on any edge of the protect, fault and alarm bits, the pack is burst polled while one is set
+	void BusEngine::checkAlarms(int packIndex, const uint8_t *previous)
+	{
+		const uint8_t *status = _working.Status[packIndex];
+		bool changed = false;
+		bool active = false;
+		for (int i = 0; i < STATUS_BIT_COUNT; i++)
+		{
+			const StatusBit &sb = StatusBits[i];
+			if (IsAlarmBit(sb))
+			{
+				bool now = CheckBit(status[sb.Register], sb.Bit);
+				bool was = CheckBit(previous[sb.Register], sb.Bit);
+				changed |= now != was;
+				active |= now;
+			}
+		}
+		_alarmPacks = active ? _alarmPacks | (1 << packIndex) : _alarmPacks & ~(1 << packIndex);
+		if (changed)
+		{
+			PackSnapshot snapshot = {};
+			snapshot.Pack = packIndex;
+			snapshot.PackCount = _Packs.size();
+			snapshot.Event = true;
+			memcpy(snapshot.PreviousStatus, previous, StatusRegisterCount);
+			memcpy(snapshot.Status, status, StatusRegisterCount);
+			snapshot.SampleEpochMillis = _working.SampleEpochMillis[packIndex];
+			queueSnapshot(snapshot);
+		}
+	}
+
+	bool BusEngine::queueSnapshot(const PackSnapshot &snapshot)
+	{
+		if (!_snapshots.Push(snapshot))
+		{
+			_counters.SnapshotOverruns++;
+			logw("Snapshot queue full, dropped Pack%d", snapshot.Pack + 1);
+			return false;
+		}
+		notifyPublisher();
+		return true;
+	}
+
+	// info, discovery and availability go out from the publish task like the readings, with a copy of the pack's topology
+	bool BusEngine::queueTopology(uint8_t packIndex, TopologyMessage message)
+	{
+		Pack &pack = _Packs[packIndex];
+		PackSnapshot snapshot = {};
+		snapshot.Pack = packIndex;
+		snapshot.PackCount = _Packs.size();
+		snapshot.Topology = message;
+		strlcpy(snapshot.Version, pack.getVersionInfo().c_str(), sizeof(snapshot.Version));
+		strlcpy(snapshot.BarCode, pack.getBarcode().c_str(), sizeof(snapshot.BarCode));
+		snapshot.Cells = pack.getNumberOfCells();
+		snapshot.Temps = pack.getNumberOfTemps();
+		return queueSnapshot(snapshot);
+	}
+
+	// the flags are set once queued, a full queue leaves them clear so the next sequence tries again
+	void BusEngine::queueInfo(uint8_t packIndex)
+	{
+		if (queueTopology(packIndex, InfoMessage))
+		{
+			_Packs[packIndex].SetInfoPublished();
+		}
+	}
+
+	void BusEngine::queueDiscovery(uint8_t packIndex)
+	{
+		if (_Packs[packIndex].ReadyToPublish() && queueTopology(packIndex, DiscoveryMessage))
+		{
+			_Packs[packIndex].SetDiscoveryPublished();
+		}
+	}
+
+	bool BusEngine::sendValidationCommand()
+	{
+		if (_validationSent || _validationStep >= _validationSteps)
+		{
+			return false;
+		}
+		if (_validationStep == 0)
+		{
+			send_cmd(0xFF, CommandInformation::GetPackCount);
+		}
+		else
+		{
+			uint8_t packIndex = (_validationStep - 1) / 2;
+			send_cmd(packIndex + 1, (_validationStep - 1) % 2 == 0 ? CommandInformation::GetVersionInfo : CommandInformation::GetBarCode);
+		}
+		_validationStep++;
+		_validationSent = true;
+		return true;
+	}
+
+	// background GetPackCount between sequences, shares the one check per sequence with the topology validation
+	bool BusEngine::sendEnumerationCommand()
+	{
+		if (_validationSent || _clock->Millis() - _lastEnumerationTimeStamp < PACK_ENUMERATION_RATE)
+		{
+			return false;
+		}
+		send_cmd(0xFF, CommandInformation::GetPackCount);
+		_lastEnumerationTimeStamp = _clock->Millis();
+		_validationSent = true;
+		return true;
+	}
+
+	// adds or removes packs at the end of the bank in place, the remaining packs keep their state and polling
+	void BusEngine::reconcilePacks(uint8_t count)
+	{
+		if (_Packs.size() > 0)
+		{
+			logw("Pack count changed from %d to %d", _Packs.size(), count);
+		}
+		while (_Packs.size() > count)
+		{
+			queueTopology(_Packs.size() - 1, OfflineMessage);
+			_Packs.pop_back();
+		}
+		createPacks(count);
+		_numberOfPacks = count;
+		_alarmPacks &= (1 << count) - 1;
+		if (_currentPack >= count)
+		{
+			_currentPack = 0;
+			_infoCommandIndex = 0;
+			_readingsCommandIndex = 0;
+			_sections = 0;
+		}
+		_validationSteps = min<uint8_t>(_validationSteps, 1 + count * 2);
+		_working.PackCount = min<size_t>(count, MAX_PACKS);
+		_bankReadings.Write(_working);
+		_topologyDirty = true;
+	}
+
+	// appends packs up to count, new packs go through the info commands and discovery
+	void BusEngine::createPacks(uint8_t count)
+	{
+		for (int i = _Packs.size(); i < count; i++)
+		{
+			char packName[STR_LEN];
+			sprintf(packName, "Pack%d", i + 1);
+			_Packs.push_back(Pack(packName, &_TempKeys, _psi));
+		}
+	}
+
+	uint16_t BusEngine::get_frame_checksum(char *frame)
+	{
+		uint16_t sum = 0;
+		uint16_t len = strlen(frame);
+		for (int i = 0; i < len; i++)
+		{
+			sum += frame[i];
+		}
+		sum = ~sum;
+		sum %= 0x10000;
+		sum += 1;
+		return sum;
+	}
+
+	int BusEngine::get_info_length(const char *info)
+	{
+		size_t lenid = strlen(info);
+		if (lenid == 0)
+			return 0;
+		int lenid_sum = (lenid & 0xf) + ((lenid >> 4) & 0xf) + ((lenid >> 8) & 0xf);
+		int lenid_modulo = lenid_sum % 16;
+		int lenid_invert_plus_one = 0b1111 - lenid_modulo + 1;
+		return (lenid_invert_plus_one << 12) + lenid;
+	}
+
+	void BusEngine::encode_cmd(char *frame, uint8_t address, uint8_t cid2, const char *info)
+	{
+		char sub_frame[64];
+		uint8_t cid1 = 0x46;
+		sprintf(sub_frame, "%02X%02X%02X%02X%04X", 0x25, address, cid1, cid2, get_info_length(info));
+		strcat(sub_frame, info);
+		sprintf(frame, "~%s%04X\r", sub_frame, get_frame_checksum(sub_frame));
+		return;
+	}
+
+	void BusEngine::send_cmd(uint8_t address, CommandInformation cmd)
+	{
+		_currentCommand = cmd;
+		char raw_frame[64];
+		memset(raw_frame, 0, 64);
+		uint32_t start = _latency.Start();
+		char bdevid[4];
+		sprintf(bdevid, "%02X", address);
+		encode_cmd(raw_frame, address, cmd, bdevid);
+		_latency.Stop(EncodeStage, start);
+		logd("send_cmd: %s", raw_frame);
+		logt(SEND_CMD, address, cmd);
+		_counters.FramesSent++;
+		_asyncSerial->Send(cmd, (byte *)raw_frame, strlen(raw_frame));
+		_sendCycles = _latency.Start();
+	}
+
+	int BusEngine::ParseResponse(char *szResponse, size_t readNow, CommandInformation cmd)
+	{
+		if (readNow > 0 && szResponse[0] != '\0')
+		{
+			uint32_t start = _latency.Start();
+			logd("received: %d", readNow);
+			logd("data: %s", szResponse);
+			std::vector<uint8_t> v;
+			FrameHeader header;
+			switch (DecodeFrame(szResponse, readNow, v, header))
+			{
+			case FrameTooShort:
+				loge("Frame too short: %d", readNow);
+				return -1;
+			case FrameChecksumError:
+				_counters.ChecksumFailures++;
+				loge("Checksum failed: %04X", header.Checksum);
+				return -1;
+			case FrameLengthError:
+				loge("Data length error LENGTH: %04X LENID: %04X, Received: %d", header.Length, header.LenId, (readNow - 17));
+				return -1;
+			case FrameOk:
+				break;
+			}
+			uint16_t ADR = header.Address;
+			uint16_t CID2 = header.Cid2;
+			uint16_t LENID = header.LenId;
+			if (_traced)
+			{
+				logt(FRAME, header.Version, ADR, CID2, LENID);
+			}
+			if (CID2 != ResponseCode::Normal)
+			{
+				loge("CID2 error code: %02X", CID2);
+				return -1;
+			}
+			FrameReader info(v.data() + 6, LENID / 2); // DecodeFrame checked LENID against the bytes decoded
+			switch (cmd)
+			{
+			case CommandInformation::AnalogValueFixedPoint:
+			{
+				uint16_t INFO = InfoHeader(info);
+				uint16_t packNumber = INFO & 0x00FF;
+				int packIndex = packNumber - 1;
+				if (packIndex < 0 || packIndex >= _Packs.size())
+				{
+					logw("AnalogValueFixedPoint of unknown Pack%d", packNumber);
+					break;
+				}
+				uint16_t numberOfCells;
+				uint16_t numberOfTemps;
+				if (!DecodeAnalog(info, _working, packIndex, _TempKeys.size(), numberOfCells, numberOfTemps))
+				{
+					loge("AnalogValueFixedPoint length error cells: %d temps: %d LENID: %04X", numberOfCells, numberOfTemps, LENID);
+					return -1;
+				}
+				if (_traced)
+				{
+					logt(ANALOG_VALUE, INFO, packNumber);
+				}
+				logd("AnalogValueFixedPoint: packIndex: %d, Pack size: %d", packIndex, _Packs.size());
+				_topologyDirty |= _Packs[packIndex].setNumberOfCells(numberOfCells);
+				_topologyDirty |= _Packs[packIndex].setNumberOfTemps(numberOfTemps);
+				_sections |= AnalogSection;
+				_working.SampleMillis[packIndex] = _frameMillis;
+				_working.SampleEpochMillis[packIndex] = _frameEpochMillis;
+			}
+			break;
+			case CommandInformation::GetVersionInfo:
+			{
+				std::string ver((const char *)info.Data(), info.Remaining());
+				int packIndex = ADR - 1;
+				if (packIndex < _Packs.size() && _Packs[packIndex].setVersionInfo(ver.substr(0, VERSION_INFO_LEN - 1)))
+				{
+					_topologyDirty = true;
+					if (_Packs[packIndex].InfoPublished())
+					{
+						queueTopology(packIndex, InfoMessage); // differs from the cached topology
+					}
+				}
+			}
+			break;
+			case CommandInformation::AlarmInfo:
+			{
+				uint16_t packNumber = InfoHeader(info) & 0x00FF;
+				int packIndex = packNumber - 1;
+				if (packIndex < 0 || packIndex >= _Packs.size())
+				{
+					logw("AlarmInfo of unknown Pack%d", packNumber);
+					break;
+				}
+				uint8_t previous[StatusRegisterCount];
+				memcpy(previous, _working.Status[packIndex], StatusRegisterCount);
+				if (!DecodeAlarm(info, _working, packIndex, _TempKeys.size()))
+				{
+					loge("AlarmInfo length error LENID: %04X", LENID);
+					return -1;
+				}
+				if (_traced)
+				{
+					logt(ALARM_INFO, packNumber);
+				}
+				_working.SampleMillis[packIndex] = _frameMillis;
+				_working.SampleEpochMillis[packIndex] = _frameEpochMillis;
+				_sections |= AlarmSection;
+				checkAlarms(packIndex, previous);
+			}
+			break;
+			case CommandInformation::GetBarCode:
+			{
+				std::string bc((const char *)info.Data(), info.Remaining());
+				logi("GetBarCode for %d bc: %s", ADR, bc.c_str());
+				int packIndex = ADR - 1;
+				if (packIndex < _Packs.size() && _Packs[packIndex].setBarcode(bc.substr(0, BAR_CODE_LEN - 1)))
+				{
+					_topologyDirty = true;
+					if (_Packs[packIndex].InfoPublished())
+					{
+						queueTopology(packIndex, InfoMessage); // differs from the cached topology
+					}
+				}
+			}
+			break;
+			case CommandInformation::GetPackCount:
+			{
+				uint8_t count;
+				if (!DecodePackCount(info, count))
+				{
+					loge("GetPackCount length error LENID: %04X", LENID);
+					return -1;
+				}
+				logi("GetPackCount: %d", count);
+				if (count == 0 || count > MAX_PACKS)
+				{
+					if (_Packs.size() > 0) // keep polling the known packs
+					{
+						logw("Ignoring pack count %d", count);
+						break;
+					}
+					count = 1; // max 8, default to 1
+				}
+				if (count != _Packs.size())
+				{
+					reconcilePacks(count);
+				}
+			}
+			break;
+			}
+			_latency.Stop(DecodeStage, start);
+		}
+		return 0;
+	}
+
+} // namespace PylonToMQTT
@@ -0,0 +1,39 @@
+#include <Arduino.h>
+#include <sys/time.h>
+#include "Clock.h"
+
+#define EPOCH_SYNCED 1577836800 // 2020-01-01, before that the system time still counts from boot
+
+namespace PylonToMQTT
+{
+	SystemClock _systemClock;
+	Clock *_clock = &_systemClock;
+
+	uint32_t SystemClock::Millis()
+	{
+		return millis();
+	}
+
+	void SystemClock::Delay(uint32_t ms)
+	{
+		vTaskDelay(pdMS_TO_TICKS(ms));
+	}
+
+	void SystemClock::Wait(uint32_t ms)
+	{
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ms));
+	}
+
+	// unlike getTime() this never waits for the sync, it is called from the bus task at every frame
+	uint64_t SystemClock::EpochMillis()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		if (tv.tv_sec < EPOCH_SYNCED)
+		{
+			return 0;
+		}
+		return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	}
+
+} // namespace PylonToMQTT
@@ -0,0 +1,147 @@
+#include "FrameDecode.h"
+
+namespace PylonToMQTT
+{
+
+	static uint8_t parse_hex(char c)
+	{
+		if ('0' <= c && c <= '9')
+			return c - '0';
+		if ('A' <= c && c <= 'F')
+			return c - 'A' + 10;
+		if ('a' <= c && c <= 'f')
+			return c - 'a' + 10;
+		return 0;
+	}
+
+	static uint8_t parse_byte(const char *hex)
+	{
+		return 16 * parse_hex(hex[0]) + parse_hex(hex[1]);
+	}
+
+	FrameStatus DecodeFrame(const char *ascii, size_t length, std::vector<uint8_t> &bytes, FrameHeader &header)
+	{
+		if (length < 17) // SOI, header and checksum
+		{
+			return FrameTooShort;
+		}
+		size_t end = length - 4; // CHKSUM
+		header.Checksum = (parse_byte(&ascii[end]) << 8) | parse_byte(&ascii[end + 2]);
+		uint16_t sum = 0;
+		for (size_t i = 1; i < end; i++)
+		{
+			sum += (uint8_t)ascii[i];
+		}
+		if (((header.Checksum + sum) & 0xFFFF) != 0)
+		{
+			return FrameChecksumError;
+		}
+		bytes.resize((end - 1) / 2); // by length, an embedded NUL is just another bad hex digit
+		for (size_t i = 0; i < bytes.size(); i++)
+		{
+			bytes[i] = parse_byte(&ascii[1 + i * 2]);
+		}
+		header.Version = bytes[0];
+		header.Address = bytes[1];
+		header.Cid1 = bytes[2];
+		header.Cid2 = bytes[3];
+		header.Length = (bytes[4] << 8) | bytes[5];
+		header.LenId = header.Length & 0x0FFF;
+		if (bytes.size() < 6 + header.LenId / 2)
+		{
+			return FrameLengthError;
+		}
+		return FrameOk;
+	}
+
+	bool DecodeAnalog(FrameReader &info, BankReadings &readings, uint8_t pack, uint8_t maxTemps, uint16_t &cells, uint16_t &temps)
+	{
+		cells = info.Fits(3) ? info.Peek(2) : 0;
+		temps = info.Fits(4 + cells * 2) ? info.Peek(3 + cells * 2) : 0;
+		if (!info.Fits(15 + cells * 2 + temps * 2))
+		{
+			return false;
+		}
+		maxTemps = maxTemps < MAX_TEMPS ? maxTemps : MAX_TEMPS;
+		info.Skip(2); // INFO header
+		info.Skip(1); // cell count, peeked above
+		readings.NumberOfCells[pack] = cells < MAX_CELLS ? cells : MAX_CELLS;
+		for (int i = 0; i < cells; i++)
+		{
+			uint16_t millivolts = info.Short();
+			if (i < MAX_CELLS)
+			{
+				readings.CellMillivolts[pack][i] = millivolts;
+			}
+		}
+		info.Skip(1); // temperature count, peeked above
+		readings.NumberOfTemps[pack] = temps < maxTemps ? temps : maxTemps;
+		for (int i = 0; i < temps; i++)
+		{
+			uint16_t deciKelvin = info.Short();
+			if (i < maxTemps)
+			{
+				readings.TempDeciKelvin[pack][i] = deciKelvin;
+			}
+		}
+		readings.CurrentCentiamps[pack] = (int16_t)info.Short();
+		readings.VoltageMillivolts[pack] = info.Short();
+		readings.RemainingCentiamphours[pack] = info.Short();
+		info.Skip(1); // skip user def code
+		readings.FullCentiamphours[pack] = info.Short();
+		readings.CycleCount[pack] = info.Short();
+		return true;
+	}
+
+	bool DecodeAlarm(FrameReader &info, BankReadings &readings, uint8_t pack, uint8_t maxTemps)
+	{
+		uint16_t cells = info.Fits(3) ? info.Peek(2) : 0;
+		uint16_t temps = info.Fits(4 + cells) ? info.Peek(3 + cells) : 0;
+		if (!info.Fits(15 + cells + temps))
+		{
+			return false;
+		}
+		maxTemps = maxTemps < MAX_TEMPS ? maxTemps : MAX_TEMPS;
+		info.Skip(3); // INFO header and cell count
+		for (int i = 0; i < cells; i++)
+		{
+			uint8_t state = info.Byte();
+			if (i < MAX_CELLS)
+			{
+				readings.CellStates[pack][i] = state;
+			}
+		}
+		info.Skip(1); // temperature count
+		for (int i = 0; i < temps; i++)
+		{
+			uint8_t state = info.Byte();
+			if (i < maxTemps)
+			{
+				readings.TempStates[pack][i] = state;
+			}
+		}
+		info.Skip(1); // skip 65
+		readings.CurrentState[pack] = info.Byte();
+		readings.VoltageState[pack] = info.Byte();
+		uint8_t *status = readings.Status[pack];
+		status[ProtectStatus1] = info.Byte();
+		status[ProtectStatus2] = info.Byte();
+		status[SystemStatus] = info.Byte();
+		status[FaultStatus] = info.Byte();
+		info.Skip(2); // skip 81, 83
+		status[AlarmStatus1] = info.Byte();
+		status[AlarmStatus2] = info.Byte();
+		return true;
+	}
+
+	bool DecodePackCount(FrameReader &info, uint8_t &count)
+	{
+		if (!info.Fits(1))
+		{
+			return false;
+		}
+		count = info.Byte();
+		return true;
+	}
+
+} // namespace PylonToMQTT
@@ -5,6 +5,9 @@
 #include "Log.h"
 #include "HelperFunctions.h"
 #include "IOT.h"
+#include "Metrics.h"
+#include "FixedPoint.h"
+#include "Clock.h"
 #include "IotWebConfOptionalGroup.h"
 #include <IotWebConfTParameter.h>
 
@@ -13,6 +16,7 @@ namespace PylonToMQTT
 
 	AsyncMqttClient _mqttClient;
 	TimerHandle_t mqttReconnectTimer;
+	SemaphoreHandle_t _publishMutex; // bank tasks share the MQTT client and the outbound queue
 	DNSServer _dnsServer;
 	HTTPUpdateServer _httpUpdater;
 	WebServer webServer(IOTCONFIG_PORT);
@@ -27,10 +31,14 @@ namespace PylonToMQTT
 	iotwebconf::PasswordTParameter<IOTWEBCONF_WORD_LEN> mqttUserPasswordParam = iotwebconf::Builder<iotwebconf::PasswordTParameter<IOTWEBCONF_WORD_LEN>>("mqttUserPassword").label("MQTT password").defaultValue("").build();
 	iotwebconf::TextTParameter<IOTWEBCONF_WORD_LEN> mqttSubtopicParam = iotwebconf::Builder<iotwebconf::TextTParameter<IOTWEBCONF_WORD_LEN>>("bankName").label("Battery Bank Name").defaultValue("Bank1").build();
 	iotwebconf::IntTParameter<int16_t> publishRateParam = iotwebconf::Builder<iotwebconf::IntTParameter<int16_t>>("publishRateStr").label("Publish Rate (S)").defaultValue(2).min(1).max(30).build();
+	IotWebConfParameterGroup powerGroup = IotWebConfParameterGroup("power", "Power");
+	iotwebconf::CheckboxTParameter lowPowerParam = iotwebconf::Builder<iotwebconf::CheckboxTParameter>("lowPower").label("Low power mode (80 MHz, Wi-Fi modem sleep)").defaultValue(false).build();
+	iotwebconf::TextTParameter<IOTWEBCONF_WORD_LEN> bank2NameParam = iotwebconf::Builder<iotwebconf::TextTParameter<IOTWEBCONF_WORD_LEN>>("bank2Name").label("Battery Bank 2 Name (blank if not used)").defaultValue("").build();
 
 	void IOT::Init(IOTCallbackInterface *iotCB)
 	{
 		_iotCB = iotCB;
+		_publishMutex = xSemaphoreCreateMutex();
 		pinMode(FACTORY_RESET_PIN, INPUT_PULLUP);
 		_iotWebConf.setStatusPin(WIFI_STATUS_PIN);
 
@@ -41,12 +49,15 @@ namespace PylonToMQTT
 		mqttGroup.addItem(&mqttUserPasswordParam);
 		mqttGroup.addItem(&mqttSubtopicParam);
 		mqttGroup.addItem(&publishRateParam);
+		mqttGroup.addItem(&bank2NameParam);
 
 		_iotWebConf.addSystemParameter(&mqttGroup);
 		if (_iotCB->parameterGroup() != NULL)
 		{
 			_iotWebConf.addParameterGroup(_iotCB->parameterGroup());
 		}
+		powerGroup.addItem(&lowPowerParam);
+		_iotWebConf.addParameterGroup(&powerGroup);
 		_iotWebConf.getApTimeoutParameter()->visible = true;
 
 		// setup callbacks for IotWebConf
@@ -99,6 +110,10 @@ namespace PylonToMQTT
 				serializeJson(doc, s);
 				s += '\n';
 				Serial.printf(s.c_str()); // send json to flash tool
+				if (lowPowerParam.value())
+				{
+					WiFi.setSleep(WIFI_PS_MAX_MODEM); // radio wakes every listen interval (3 beacons) for buffered frames
+				}
 				configTime(0, 0, NTP_SERVER);
 				printLocalTime();
 				xTimerStart(mqttReconnectTimer, 0);
@@ -133,10 +148,23 @@ namespace PylonToMQTT
 					sprintf(buf, "%s/cmnd/#", _rootTopicPrefix);
 					_mqttClient.subscribe(buf, 0);
 					IOTCB()->onMqttConnect(sessionPresent);
+					for (int i = 0; i < _bankCount - 1; i++) // each bank takes its commands under its own root topic
+					{
+						snprintf(buf, sizeof(buf), "%s/cmnd/#", _banks[i].getRootTopicPrefix().c_str());
+						_mqttClient.subscribe(buf, 0);
+						if (_banks[i].IOTCB() != NULL)
+						{
+							_banks[i].IOTCB()->onMqttConnect(sessionPresent);
+						}
+					}
+					xSemaphoreTake(_publishMutex, portMAX_DELAY); // the bank tasks may be publishing in drain
 					_mqttClient.publish(_willTopic, 0, true, "Offline"); // toggle online in run loop
+					xSemaphoreGive(_publishMutex);
+					drain();
 				});
 				_mqttClient.onDisconnect([this](AsyncMqttClientDisconnectReason reason)	{ 
 					logw("Disconnected from MQTT. Reason: %d", (int8_t)reason);
+					resetWindow();
 					if (WiFi.isConnected())
 					{
 						xTimerStart(mqttReconnectTimer, 5000);
@@ -144,31 +172,61 @@ namespace PylonToMQTT
 				});
 				_mqttClient.onMessage([this](char *topic, char *payload, AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total)	{ 
 					logd("MQTT Message arrived [%s]  qos: %d len: %d index: %d total: %d", topic, properties.qos, len, index, total);
+					char buf[64];
+					sprintf(buf, "%s/cmnd/loglevel", _rootTopicPrefix);
+					if (strcmp(topic, buf) == 0)
+					{
+						std::string level(payload, len);
+						if (!weblog_set_level(level.c_str()))
+						{
+							logw("Unknown log level: %s", level.c_str());
+						}
+						return;
+					}
+					IOTServiceInterface *bank = this;
+					IOTCallbackInterface *bankCB = IOTCB();
+					for (int i = 0; i < _bankCount - 1; i++)
+					{
+						std::string prefix = _banks[i].getRootTopicPrefix() + "/cmnd/";
+						if (strncmp(topic, prefix.c_str(), prefix.length()) == 0)
+						{
+							bank = &_banks[i];
+							bankCB = _banks[i].IOTCB();
+						}
+					}
+					if (bankCB == NULL)
+					{
+						logw("No bank for %s", topic);
+						return;
+					}
 					JsonDocument doc;
-					DeserializationError err = deserializeJson(doc, payload);
+					DeserializationError err = deserializeJson(doc, payload, len);
 					if (err) // not json!
 					{
-						logd("MQTT payload {%s} is not valid JSON!", payload);
+						logd("MQTT payload {%.*s} is not valid JSON!", len, payload);
 					}
 					else
 					{
 						if (doc.containsKey("status"))
 						{
 							doc.clear();
-							doc["name"] = mqttSubtopicParam.value();
+							doc["name"] = bank->getSubtopicName();
 							doc["sw_version"] = CONFIG_VERSION;
 							doc["IP"] = WiFi.localIP().toString().c_str();
 							doc["SSID"] = WiFi.SSID();
 							doc["uptime"] = formatDuration(millis() - _lastBootTimeStamp);
-							Publish("status", doc, true);
+							bank->Publish("status", doc, true);
 						}
 						else
 						{
-							IOTCB()->onMqttMessage(topic, doc);
+							bankCB->onMqttMessage(topic, doc);
 						}
 					}
 				});
-				_mqttClient.onPublish([this](uint16_t packetId)	{ logd("Publish acknowledged.  packetId: %d", packetId); });
+				_mqttClient.onPublish([this](uint16_t packetId)	{ 
+					acknowledge(packetId);
+					drain();
+				});
 				IPAddress ip;
 				if (ip.fromString(mqttServerParam.value()))
 				{
@@ -190,7 +248,17 @@ namespace PylonToMQTT
 				sprintf(_willTopic, "%s/tele/LWT", _rootTopicPrefix);
 				logd("_willTopic: %s", _willTopic);
 				_mqttClient.setWill(_willTopic, 0, true, "Offline");
-				
+				if (lowPowerParam.value())
+				{
+					setCpuFrequencyMhz(LOW_POWER_CPU_MHZ);
+					_mqttClient.setKeepAlive(LOW_POWER_KEEPALIVE);
+					logi("Low power mode, CPU at %d MHz", getCpuFrequencyMhz());
+				}
+				if (bank2NameParam.value()[0] != '\0')
+				{
+					_banks[0].Init(this, 1, bank2NameParam.value());
+					_bankCount = 2;
+				}
 			}
 		}
 		// generate unique id from mac address NIC segment
@@ -223,6 +291,9 @@ namespace PylonToMQTT
 			ss << htmlConfigEntry<char *>(mqttUserNameParam.label, mqttUserNameParam.value()).c_str();
 			ss << htmlConfigEntry<const char *>(mqttUserPasswordParam.label, strlen(mqttUserPasswordParam.value()) > 0 ? "********" : "").c_str();
 			ss << htmlConfigEntry<char *>(mqttSubtopicParam.label, mqttSubtopicParam.value()).c_str();
+			ss << htmlConfigEntry<char *>(bank2NameParam.label, bank2NameParam.value()).c_str();
+			ss << "</ul> Power: <ul>";
+			ss << htmlConfigEntry<const char *>(lowPowerParam.label, lowPowerParam.value() ? "Yes" : "No").c_str();
 			ss << "</ul> <div style='padding-top:25px;'> <p><a href='/' onclick='javascript:event.target.port=";
 			ss << ASYNC_WEBSERVER_PORT;
 			ss << "'>Return to home page.</a></p>";
@@ -280,6 +351,10 @@ namespace PylonToMQTT
 		if (_clientsConfigured && WiFi.isConnected())
 		{
 			rVal = _mqttClient.connected();
+			if (rVal)
+			{
+				drain();
+			}
 		}
 		else
 		{
@@ -334,43 +409,138 @@ namespace PylonToMQTT
 		return Publish(subtopic, s.c_str(), retained);
 	}
 
-	boolean IOT::Publish(const char *subtopic, const char *value, boolean retained)
+	boolean IOT::Publish(const char *subtopic, const char *value, boolean retained, uint32_t sampleMillis)
+	{
+		char buf[64];
+		sprintf(buf, "%s/stat/%s", _rootTopicPrefix, subtopic);
+		return PublishMessage(buf, value, retained, sampleMillis);
+	}
+
+	boolean IOT::Publish(const char *topic, float value, boolean retained)
+	{
+		FixedPoint tenths(lroundf(value * 10), 1);
+		return Publish(topic, tenths.Text, retained);
+	}
+
+	boolean IOT::PublishMessage(const char *topic, JsonDocument &payload, boolean retained)
+	{
+		String s;
+		serializeJson(payload, s);
+		return PublishMessage(topic, s.c_str(), retained);
+	}
+
+	boolean IOT::PublishMessage(const char *topic, const char *payload, boolean retained, uint32_t sampleMillis, uint8_t bank)
 	{
 		boolean rVal = false;
 		if (_mqttClient.connected())
 		{
-			char buf[64];
-			sprintf(buf, "%s/stat/%s", _rootTopicPrefix, subtopic);
-			rVal = _mqttClient.publish(buf, 0, retained, value) > 0;
-			if (!rVal)
+			xSemaphoreTake(_publishMutex, portMAX_DELAY);
+			rVal = _outbound.Push(priorityOf(topic), topic, payload, retained, sampleMillis, bank);
+			xSemaphoreGive(_publishMutex);
+			drain();
+		}
+		return rVal;
+	}
+
+	// classify by topic so every publisher goes through the same queue without knowing about it
+	PublishPriority IOT::priorityOf(const char *topic)
+	{
+		if (strncmp(topic, HOME_ASSISTANT_PREFIX "/", strlen(HOME_ASSISTANT_PREFIX) + 1) == 0)
+		{
+			return DiscoveryPriority;
+		}
+		const char *subtopic = strstr(topic, "/stat/");
+		if (subtopic != NULL)
+		{
+			subtopic += 6;
+			if (strncmp(subtopic, "readings/", 9) == 0 || strncmp(subtopic, "poll/", 5) == 0 || strncmp(subtopic, "capture/", 8) == 0)
+			{
+				return ReadingsPriority;
+			}
+			if (strcmp(subtopic, "event") == 0)
+			{
+				return AlarmPriority;
+			}
+			if (strncmp(subtopic, "info/", 5) == 0 || strncmp(subtopic, "availability/", 13) == 0)
 			{
-				loge("**** Failed to publish MQTT message");
+				return DiscoveryPriority;
 			}
 		}
-		return rVal;
+		return LogPriority;
 	}
 
-	boolean IOT::Publish(const char *topic, float value, boolean retained)
+	// hand queued messages to the client while the broker keeps up, the window is released by PUBACKs
+	void IOT::drain()
 	{
-		char buf[256];
-		snprintf_P(buf, sizeof(buf), "%.1f", value);
-		return Publish(topic, buf, retained);
+		xSemaphoreTake(_publishMutex, portMAX_DELAY);
+		if (_inFlightCount > 0 && _clock->Millis() - _lastAckTimeStamp > MQTT_ACK_TIMEOUT)
+		{
+			logw("No PUBACK for %d messages, releasing the publish window", _inFlightCount);
+			_inFlightCount = 0;
+			_inFlightBytes = 0;
+		}
+		QueuedMessage *message;
+		while (_mqttClient.connected() && _inFlightCount < MQTT_IN_FLIGHT && (message = _outbound.Peek()) != NULL)
+		{
+			size_t len = message->Payload.size();
+			if (_inFlightCount > 0 && _inFlightBytes + len > MQTT_IN_FLIGHT_BYTES)
+			{
+				break; // wait for the broker, an oversize message goes out on its own
+			}
+			uint8_t qos = message->Priority == LogPriority ? 0 : 1; // diag, benchmark and status are best effort and take no window slot
+			uint16_t packetId = _mqttClient.publish(message->Topic.c_str(), qos, message->Retained, message->Payload.c_str(), len);
+			if (packetId == 0)
+			{
+				_metrics.PublishFailures++;
+				loge("**** Failed to publish MQTT message, payload may exceed MAX MQTT Packet Size, %d bytes topic: %s", len, message->Topic.c_str());
+				_outbound.Pop();
+				continue;
+			}
+			if (message->SampleMillis != 0) // queuing is part of the data age, the broker and consumers add their own share on top
+			{
+				_metrics.DataAge(message->Bank, _clock->Millis() - message->SampleMillis);
+			}
+			if (qos == 0)
+			{
+				_outbound.Pop();
+				continue;
+			}
+			if (_inFlightCount == 0)
+			{
+				_lastAckTimeStamp = _clock->Millis();
+			}
+			_inFlight[_inFlightCount].PacketId = packetId;
+			_inFlight[_inFlightCount].Bytes = len;
+			_inFlightCount++;
+			_inFlightBytes += len;
+			_outbound.Pop();
+		}
+		xSemaphoreGive(_publishMutex);
 	}
 
-	boolean IOT::PublishMessage(const char *topic, JsonDocument &payload, boolean retained)
+	void IOT::acknowledge(uint16_t packetId)
 	{
-		boolean rVal = false;
-		if (_mqttClient.connected())
+		xSemaphoreTake(_publishMutex, portMAX_DELAY);
+		for (int i = 0; i < _inFlightCount; i++)
 		{
-			String s;
-			serializeJson(payload, s);
-			rVal = _mqttClient.publish(topic, 0, retained, s.c_str(), s.length()) > 0;
-			if (!rVal)
+			if (_inFlight[i].PacketId == packetId)
 			{
-				loge("**** Configuration payload exceeds MAX MQTT Packet Size, %d [%s] topic: %s", s.length(), s.c_str(), topic);
+				_inFlightBytes -= _inFlight[i].Bytes;
+				_inFlight[i] = _inFlight[--_inFlightCount];
+				_lastAckTimeStamp = _clock->Millis();
+				break;
 			}
 		}
-		return rVal;
+		xSemaphoreGive(_publishMutex);
+	}
+
+	// PUBACKs for the old session never arrive, queued messages go out after the reconnect
+	void IOT::resetWindow()
+	{
+		xSemaphoreTake(_publishMutex, portMAX_DELAY);
+		_inFlightCount = 0;
+		_inFlightBytes = 0;
+		xSemaphoreGive(_publishMutex);
 	}
 
 	boolean IOT::PublishHADiscovery(const char *bank, JsonDocument &payload)
@@ -403,12 +573,109 @@ namespace PylonToMQTT
 		return s;
 	}
 
+	std::string IOT::getWillTopic()
+	{
+		std::string s(_willTopic);
+		return s;
+	}
+
 	void IOT::Online()
 	{
 		if (!_publishedOnline)
 		{
+			xSemaphoreTake(_publishMutex, portMAX_DELAY);
 			_publishedOnline = _mqttClient.publish(_willTopic, 0, true, "Online");
+			xSemaphoreGive(_publishMutex);
+		}
+	}
+
+	boolean IOT::LowPower()
+	{
+		return lowPowerParam.value();
+	}
+
+	boolean IOT::Connected()
+	{
+		return _clientsConfigured && WiFi.isConnected() && _mqttClient.connected();
+	}
+
+	void BankService::Init(IOT *iot, uint8_t index, const char *name)
+	{
+		_iot = iot;
+		_index = index;
+		_name = name;
+		_rootTopicPrefix = _iot->getThingName();
+		if (_rootTopicPrefix.back() != '/')
+		{
+			_rootTopicPrefix += '/';
 		}
+		_rootTopicPrefix += _name;
+		logd("Bank %s rootTopicPrefix: %s", name, _rootTopicPrefix.c_str());
+	}
+
+	boolean BankService::Publish(const char *subtopic, const char *value, boolean retained, uint32_t sampleMillis)
+	{
+		char buf[64];
+		sprintf(buf, "%s/stat/%s", _rootTopicPrefix.c_str(), subtopic);
+		return _iot->PublishMessage(buf, value, retained, sampleMillis, _index);
+	}
+
+	boolean BankService::Publish(const char *subtopic, JsonDocument &payload, boolean retained)
+	{
+		String s;
+		serializeJson(payload, s);
+		return Publish(subtopic, s.c_str(), retained);
+	}
+
+	boolean BankService::Publish(const char *subtopic, float value, boolean retained)
+	{
+		FixedPoint tenths(lroundf(value * 10), 1);
+		return Publish(subtopic, tenths.Text, retained);
+	}
+
+	boolean BankService::PublishMessage(const char *topic, JsonDocument &payload, boolean retained)
+	{
+		return _iot->PublishMessage(topic, payload, retained);
+	}
+
+	boolean BankService::PublishHADiscovery(const char *bank, JsonDocument &payload)
+	{
+		return _iot->PublishHADiscovery(bank, payload);
+	}
+
+	u_int BankService::getUniqueId()
+	{
+		return _iot->getUniqueId();
+	}
+
+	std::string BankService::getThingName()
+	{
+		return _iot->getThingName();
+	}
+
+	std::string BankService::getWillTopic()
+	{
+		return _iot->getWillTopic(); // one MQTT connection, availability follows the device
+	}
+
+	void BankService::Online()
+	{
+		_iot->Online();
+	}
+
+	boolean BankService::Connected()
+	{
+		return _iot->Connected();
+	}
+
+	unsigned long BankService::PublishRate()
+	{
+		return _iot->PublishRate();
+	}
+
+	boolean BankService::LowPower()
+	{
+		return _iot->LowPower();
 	}
 
 } // namespace PylonToMQTT
\ No newline at end of file
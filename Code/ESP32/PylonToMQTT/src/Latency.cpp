@@ -0,0 +1,54 @@
+#include "Log.h"
+#include "Latency.h"
+
+namespace PylonToMQTT
+{
+	const char *const LatencyStageNames[] = {"Encode", "RoundTrip", "Decode", "JsonBuild", "Serialize", "Publish"};
+
+	// fills doc with the percentiles of the current window and keeps an html copy for the settings page
+	void Latency::Report(JsonDocument &doc)
+	{
+		char buf[128];
+		std::string &report = _lastReport.Edit();
+		report = "<table><tr><th>Stage (&micro;s)</th><th>count</th><th>p50</th><th>p95</th><th>p99</th><th>max</th></tr>";
+		for (int i = 0; i < LatencyStageCount; i++)
+		{
+			portENTER_CRITICAL(&_mux);
+			Histogram h = _histograms[i]; // percentiles are computed on the copy, outside the critical section
+			portEXIT_CRITICAL(&_mux);
+			JsonObject stage = doc[LatencyStageNames[i]].to<JsonObject>();
+			stage["count"] = h.Count();
+			stage["p50"] = h.Percentile(50);
+			stage["p95"] = h.Percentile(95);
+			stage["p99"] = h.Percentile(99);
+			stage["max"] = h.Max();
+			sprintf(buf, "<tr><td>%s</td><td>%u</td><td>%u</td><td>%u</td><td>%u</td><td>%u</td></tr>", LatencyStageNames[i], h.Count(), h.Percentile(50), h.Percentile(95), h.Percentile(99), h.Max());
+			report += buf;
+		}
+		report += "</table>";
+		_lastReport.Commit();
+	}
+
+	String Latency::getSettingsHTML()
+	{
+		std::shared_ptr<const std::string> report = _lastReport.Get();
+		if (report->empty())
+		{
+			return "Latency: collecting";
+		}
+		String s = "Latency:";
+		s += report->c_str();
+		return s;
+	}
+
+	void Latency::Reset()
+	{
+		portENTER_CRITICAL(&_mux);
+		for (int i = 0; i < LatencyStageCount; i++)
+		{
+			_histograms[i].Reset();
+		}
+		portEXIT_CRITICAL(&_mux);
+	}
+
+} // namespace PylonToMQTT
@@ -0,0 +1,231 @@
+#include <ESPAsyncWebServer.h>
+#include "Log.h"
+#include "FixedPoint.h"
+#include "Metrics.h"
+#include "StatusBits.h"
+
+namespace PylonToMQTT
+{
+	Metrics _metrics;
+
+	void Metrics::begin(AsyncWebServer *pwebServer)
+	{
+		if (_started)
+		{
+			return;
+		}
+		_started = true;
+		pwebServer->on("/metrics", HTTP_GET, [this](AsyncWebServerRequest *request)
+					   {
+			std::shared_ptr<const std::string> body = _body.Get();
+			AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain; version=0.0.4", [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+																			 {
+				size_t len = min(maxLen, body->size() - index);
+				memcpy(buffer, body->data() + index, len);
+				return len; });
+			request->send(response); });
+	}
+
+	void Metrics::appendf(std::string &body, const char *format, ...)
+	{
+		char buf[STR_LEN];
+		va_list arg;
+		va_start(arg, format);
+		int len = vsnprintf(buf, sizeof(buf), format, arg);
+		va_end(arg);
+		if (len > 0)
+		{
+			body.append(buf, min(len, (int)sizeof(buf) - 1));
+		}
+	}
+
+	void Metrics::header(std::string &body, const char *name, const char *type, const char *help)
+	{
+		appendf(body, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+	}
+
+	void Metrics::AddBank(const std::string &bank, BankCounters *counters, const Seqlock<BankReadings> *readings)
+	{
+		if (_bankCount < MAX_BANKS)
+		{
+			_bankNames[_bankCount] = bank;
+			_readingsSource[_bankCount] = readings;
+			_banks[_bankCount++] = counters;
+		}
+	}
+
+	// from IOT::drain when the client takes a message carrying a sample time
+	void Metrics::DataAge(uint8_t bank, uint32_t age)
+	{
+		if (bank < _bankCount)
+		{
+			_banks[bank]->DataAgeMillis = age;
+			if (age > _banks[bank]->DataAgeCycleMillis)
+			{
+				_banks[bank]->DataAgeCycleMillis = age;
+			}
+		}
+	}
+
+	// one series per bank
+	void Metrics::bankCounter(std::string &body, const char *name, const char *help, std::atomic<uint32_t> BankCounters::*counter)
+	{
+		header(body, name, "counter", help);
+		for (int i = 0; i < _bankCount; i++)
+		{
+			appendf(body, "%s{bank=\"%s\"} %u\n", name, _bankNames[i].c_str(), (_banks[i]->*counter).load());
+		}
+	}
+
+	void Metrics::bankValue(std::string &body, const char *name, const char *help, std::atomic<uint32_t> BankCounters::*gauge)
+	{
+		header(body, name, "gauge", help);
+		for (int i = 0; i < _bankCount; i++)
+		{
+			appendf(body, "%s{bank=\"%s\"} %u\n", name, _bankNames[i].c_str(), (_banks[i]->*gauge).load());
+		}
+	}
+
+	void Metrics::bankGauge(std::string &body, const char *name, const char *help, std::atomic<float> BankCounters::*gauge)
+	{
+		header(body, name, "gauge", help);
+		for (int i = 0; i < _bankCount; i++)
+		{
+			appendf(body, "%s{bank=\"%s\"} %s\n", name, _bankNames[i].c_str(), FixedPoint(lroundf((_banks[i]->*gauge).load() * 10), 1).Text);
+		}
+	}
+
+	// pack gauges of every registered bank from its own readings, the counters are per bank too
+	void Metrics::Render(std::vector<std::string> &tempKeys)
+	{
+		for (int i = 0; i < _bankCount; i++)
+		{
+			_readingsSource[i]->Read(_readings[i]);
+		}
+		std::string &body = _body.Edit();
+
+		header(body, "pylon_pack_voltage_volts", "gauge", "Pack voltage");
+		for (int i = 0; i < _bankCount; i++)
+		{
+			for (int p = 0; p < _readings[i].PackCount; p++)
+			{
+				appendf(body, "pylon_pack_voltage_volts{bank=\"%s\",pack=\"%d\"} %s\n", _bankNames[i].c_str(), p + 1, FixedPoint(_readings[i].VoltageMillivolts[p], 3).Text);
+			}
+		}
+		header(body, "pylon_pack_current_amps", "gauge", "Pack current, negative when discharging");
+		for (int i = 0; i < _bankCount; i++)
+		{
+			for (int p = 0; p < _readings[i].PackCount; p++)
+			{
+				appendf(body, "pylon_pack_current_amps{bank=\"%s\",pack=\"%d\"} %s\n", _bankNames[i].c_str(), p + 1, FixedPoint(_readings[i].CurrentCentiamps[p], 2).Text);
+			}
+		}
+		header(body, "pylon_pack_soc_percent", "gauge", "Pack state of charge");
+		for (int i = 0; i < _bankCount; i++)
+		{
+			for (int p = 0; p < _readings[i].PackCount; p++)
+			{
+				appendf(body, "pylon_pack_soc_percent{bank=\"%s\",pack=\"%d\"} %d\n", _bankNames[i].c_str(), p + 1, _readings[i].SOC(p));
+			}
+		}
+		header(body, "pylon_pack_remaining_capacity_amp_hours", "gauge", "Pack remaining capacity");
+		for (int i = 0; i < _bankCount; i++)
+		{
+			for (int p = 0; p < _readings[i].PackCount; p++)
+			{
+				appendf(body, "pylon_pack_remaining_capacity_amp_hours{bank=\"%s\",pack=\"%d\"} %s\n", _bankNames[i].c_str(), p + 1, FixedPoint(_readings[i].RemainingCentiamphours[p], 2).Text);
+			}
+		}
+		header(body, "pylon_pack_full_capacity_amp_hours", "gauge", "Pack full capacity");
+		for (int i = 0; i < _bankCount; i++)
+		{
+			for (int p = 0; p < _readings[i].PackCount; p++)
+			{
+				appendf(body, "pylon_pack_full_capacity_amp_hours{bank=\"%s\",pack=\"%d\"} %s\n", _bankNames[i].c_str(), p + 1, FixedPoint(_readings[i].FullCentiamphours[p], 2).Text);
+			}
+		}
+		header(body, "pylon_pack_cycles", "gauge", "Pack cycle count");
+		for (int i = 0; i < _bankCount; i++)
+		{
+			for (int p = 0; p < _readings[i].PackCount; p++)
+			{
+				appendf(body, "pylon_pack_cycles{bank=\"%s\",pack=\"%d\"} %d\n", _bankNames[i].c_str(), p + 1, _readings[i].CycleCount[p]);
+			}
+		}
+		header(body, "pylon_cell_voltage_volts", "gauge", "Cell voltage");
+		for (int i = 0; i < _bankCount; i++)
+		{
+			for (int p = 0; p < _readings[i].PackCount; p++)
+			{
+				for (int c = 0; c < _readings[i].NumberOfCells[p]; c++)
+				{
+					appendf(body, "pylon_cell_voltage_volts{bank=\"%s\",pack=\"%d\",cell=\"%d\"} %s\n", _bankNames[i].c_str(), p + 1, c + 1, FixedPoint(_readings[i].CellMillivolts[p][c], 3).Text);
+				}
+			}
+		}
+		header(body, "pylon_cell_state", "gauge", "Cell alarm state, 1 below lower limit, 2 above upper limit");
+		for (int i = 0; i < _bankCount; i++)
+		{
+			for (int p = 0; p < _readings[i].PackCount; p++)
+			{
+				for (int c = 0; c < _readings[i].NumberOfCells[p]; c++)
+				{
+					appendf(body, "pylon_cell_state{bank=\"%s\",pack=\"%d\",cell=\"%d\"} %d\n", _bankNames[i].c_str(), p + 1, c + 1, _readings[i].CellStates[p][c]);
+				}
+			}
+		}
+		header(body, "pylon_temperature_celsius", "gauge", "Pack temperature sensors");
+		for (int i = 0; i < _bankCount; i++)
+		{
+			for (int p = 0; p < _readings[i].PackCount; p++)
+			{
+				for (int t = 0; t < _readings[i].NumberOfTemps[p] && t < tempKeys.size(); t++)
+				{
+					appendf(body, "pylon_temperature_celsius{bank=\"%s\",pack=\"%d\",sensor=\"%s\"} %s\n", _bankNames[i].c_str(), p + 1, tempKeys[t].c_str(), FixedPoint(_readings[i].TempDeciKelvin[p][t] - 2730, 1).Text);
+				}
+			}
+		}
+		header(body, "pylon_status_flag", "gauge", "AlarmInfo status bits");
+		for (int i = 0; i < _bankCount; i++)
+		{
+			for (int p = 0; p < _readings[i].PackCount; p++)
+			{
+				for (int s = 0; s < STATUS_BIT_COUNT; s++)
+				{
+					const StatusBit &sb = StatusBits[s];
+					appendf(body, "pylon_status_flag{bank=\"%s\",pack=\"%d\",group=\"%s\",flag=\"%s\"} %d\n", _bankNames[i].c_str(), p + 1, sb.Group, sb.Name, CheckBit(_readings[i].Status[p][sb.Register], sb.Bit));
+				}
+			}
+		}
+
+		bankCounter(body, "pylon_frames_sent_total", "Commands sent to the battery", &BankCounters::FramesSent);
+		bankCounter(body, "pylon_frames_received_total", "Responses received from the battery", &BankCounters::FramesReceived);
+		bankCounter(body, "pylon_checksum_failures_total", "Responses rejected by checksum", &BankCounters::ChecksumFailures);
+		bankCounter(body, "pylon_serial_timeouts_total", "Commands without a response", &BankCounters::Timeouts);
+		bankCounter(body, "pylon_serial_overflows_total", "Responses exceeding the receive buffer", &BankCounters::Overflows);
+		bankCounter(body, "pylon_snapshot_overruns_total", "Pack snapshots dropped because the publisher fell behind", &BankCounters::SnapshotOverruns);
+		header(body, "pylon_publish_failures_total", "counter", "MQTT messages the client refused, all banks share the client");
+		appendf(body, "pylon_publish_failures_total %u\n", PublishFailures.load());
+		header(body, "pylon_mqtt_queue_depth", "gauge", "Outbound MQTT messages waiting for the client");
+		appendf(body, "pylon_mqtt_queue_depth %u\n", QueueDepth.load());
+		header(body, "pylon_mqtt_queue_coalesced_total", "counter", "Queued readings replaced by a newer reading for the same topic");
+		appendf(body, "pylon_mqtt_queue_coalesced_total %u\n", QueueCoalesced.load());
+		header(body, "pylon_mqtt_queue_drops_total", "counter", "Outbound MQTT messages dropped because the queue was full");
+		for (int i = 0; i < PublishPriorityCount; i++)
+		{
+			appendf(body, "pylon_mqtt_queue_drops_total{class=\"%s\"} %u\n", PublishPriorityNames[i], QueueDrops[i].load());
+		}
+		bankGauge(body, "pylon_modelled_current_milliamps", "Average current of the last poll cycle modelled from the bus task's awake time, low power mode only", &BankCounters::AverageMilliamps);
+		bankGauge(body, "pylon_duty_cycle_percent", "Share of the last poll cycle the bus task was awake, low power mode only", &BankCounters::DutyPercent);
+		bankValue(body, "pylon_data_age_milliseconds", "Time from the serial frame to the MQTT client taking the last readings from the queue", &BankCounters::DataAgeMillis);
+		bankValue(body, "pylon_data_age_max_milliseconds", "Oldest readings taken by the MQTT client in the bank's last poll cycle", &BankCounters::DataAgeMaxMillis);
+		header(body, "pylon_free_heap_bytes", "gauge", "Free heap");
+		appendf(body, "pylon_free_heap_bytes %u\n", ESP.getFreeHeap());
+		header(body, "pylon_min_free_heap_bytes", "gauge", "Lowest free heap since boot");
+		appendf(body, "pylon_min_free_heap_bytes %u\n", ESP.getMinFreeHeap());
+		header(body, "pylon_uptime_seconds", "counter", "Time since boot");
+		appendf(body, "pylon_uptime_seconds %lu\n", millis() / 1000);
+		_body.Commit();
+	}
+
+} // namespace PylonToMQTT
@@ -0,0 +1,124 @@
+#include "ModbusServer.h"
+
+// register map and request handling of the Modbus TCP server, free of AsyncTCP so the native tests link it
+
+namespace PylonToMQTT
+{
+	// called from the publisher after each pack is published
+	void ModbusServer::Update(const BankReadings &readings)
+	{
+		uint8_t packCount = readings.PackCount;
+		uint16_t registers[MODBUS_PACK_REGISTERS];
+		for (int i = 0; i < packCount; i++)
+		{
+			encodePack(registers, readings, i);
+			portENTER_CRITICAL(&_mux);
+			memcpy(_registers[i], registers, sizeof(registers));
+			portEXIT_CRITICAL(&_mux);
+		}
+		_packCount = packCount;
+	}
+
+	void ModbusServer::encodePack(uint16_t *registers, const BankReadings &readings, uint8_t pack)
+	{
+		registers[0] = readings.VoltageMillivolts[pack];
+		registers[1] = (uint16_t)readings.CurrentCentiamps[pack];
+		registers[2] = readings.SOC(pack);
+		registers[3] = readings.RemainingCentiamphours[pack];
+		registers[4] = readings.FullCentiamphours[pack];
+		registers[5] = readings.CycleCount[pack];
+		registers[6] = readings.NumberOfCells[pack];
+		registers[7] = readings.NumberOfTemps[pack];
+		registers[8] = readings.CurrentState[pack];
+		registers[9] = readings.VoltageState[pack];
+		for (int i = 0; i < StatusRegisterCount; i++)
+		{
+			registers[10 + i] = readings.Status[pack][i];
+		}
+		memcpy(&registers[16], readings.CellMillivolts[pack], sizeof(readings.CellMillivolts[pack]));
+		for (int i = 0; i < MAX_CELLS; i++)
+		{
+			registers[32 + i] = readings.CellStates[pack][i];
+		}
+		memcpy(&registers[48], readings.TempDeciKelvin[pack], sizeof(readings.TempDeciKelvin[pack]));
+		for (int i = 0; i < MAX_TEMPS; i++)
+		{
+			registers[54 + i] = readings.TempStates[pack][i];
+		}
+	}
+
+	size_t ModbusServer::exception(const uint8_t *request, uint8_t code, uint8_t *response)
+	{
+		memcpy(response, request, MBAP_SIZE);
+		response[4] = 0;
+		response[5] = 3; // unit id, function, exception code
+		response[7] = request[7] | 0x80;
+		response[8] = code;
+		return MBAP_SIZE + 2;
+	}
+
+	// request starts with the MBAP header, returns the response length
+	size_t ModbusServer::HandleRequest(const uint8_t *request, size_t length, uint8_t *response)
+	{
+		if (request[2] != 0 || request[3] != 0)
+		{
+			return 0; // not modbus
+		}
+		uint8_t unit = request[6];
+		uint8_t function = request[7];
+		if (function != 0x03 && function != 0x04)
+		{
+			return exception(request, 0x01, response); // illegal function, registers are read only
+		}
+		if (length < MBAP_SIZE + 5)
+		{
+			return exception(request, 0x03, response);
+		}
+		uint16_t address = (request[8] << 8) | request[9];
+		uint16_t quantity = (request[10] << 8) | request[11];
+		if (quantity == 0 || quantity > MODBUS_MAX_READ)
+		{
+			return exception(request, 0x03, response); // illegal data value
+		}
+		uint16_t registerCount;
+		int pack = 0;
+		uint16_t stride = MODBUS_PACK_REGISTERS;
+		if (unit == 0 || unit == 0xFF)
+		{
+			stride = MODBUS_BANK_STRIDE;
+			registerCount = _packCount == 0 ? 0 : (_packCount - 1) * MODBUS_BANK_STRIDE + MODBUS_PACK_REGISTERS;
+		}
+		else if (unit <= _packCount)
+		{
+			pack = unit - 1;
+			registerCount = MODBUS_PACK_REGISTERS;
+		}
+		else
+		{
+			return exception(request, 0x0B, response); // gateway target failed to respond
+		}
+		if (address + quantity > registerCount)
+		{
+			return exception(request, 0x02, response); // illegal data address
+		}
+		memcpy(response, request, MBAP_SIZE);
+		uint16_t mbapLength = 3 + quantity * 2; // unit id, function, byte count, data
+		response[4] = mbapLength >> 8;
+		response[5] = mbapLength & 0xFF;
+		response[7] = function;
+		response[8] = quantity * 2;
+		uint8_t *data = &response[9];
+		portENTER_CRITICAL(&_mux);
+		for (int i = 0; i < quantity; i++)
+		{
+			uint16_t r = address + i;
+			uint16_t index = r % stride;
+			uint16_t value = index < MODBUS_PACK_REGISTERS ? _registers[pack + r / stride][index] : 0; // gaps between packs read as 0
+			*data++ = value >> 8;
+			*data++ = value & 0xFF;
+		}
+		portEXIT_CRITICAL(&_mux);
+		return MBAP_SIZE + 2 + quantity * 2;
+	}
+
+} // namespace PylonToMQTT
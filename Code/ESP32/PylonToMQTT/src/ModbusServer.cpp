@@ -0,0 +1,50 @@
+#include <AsyncTCP.h>
+#include "Log.h"
+#include "ModbusServer.h"
+
+namespace PylonToMQTT
+{
+	AsyncServer _modbusTcpServer(MODBUS_TCP_PORT);
+	uint8_t _modbusClients = 0;
+
+	void ModbusServer::begin()
+	{
+		if (_started)
+		{
+			return;
+		}
+		_started = true;
+		_modbusTcpServer.onClient([](void *arg, AsyncClient *client)
+							   {
+			ModbusServer *server = (ModbusServer *)arg;
+			if (_modbusClients >= MODBUS_MAX_CLIENTS)
+			{
+				logw("Modbus client limit reached, rejecting %s", client->remoteIP().toString().c_str());
+				client->close(true);
+				delete client;
+				return;
+			}
+			_modbusClients++;
+			logi("Modbus client connected %s", client->remoteIP().toString().c_str());
+			ModbusConnection *connection = new ModbusConnection();
+			client->onDisconnect([connection](void *arg, AsyncClient *client)
+								 {
+				_modbusClients--;
+				logi("Modbus client disconnected");
+				delete connection;
+				delete client; });
+			client->onData([server, connection](void *arg, AsyncClient *client, void *data, size_t len)
+						   {
+				bool valid = connection->Receive(*server, (const uint8_t *)data, len, [client](const uint8_t *response, size_t length)
+												 { client->write((const char *)response, length); });
+				if (!valid)
+				{
+					logw("Modbus invalid frame length %d", connection->FrameLength());
+					client->close();
+				}
+			}, nullptr); }, this);
+		_modbusTcpServer.setNoDelay(true);
+		_modbusTcpServer.begin();
+	}
+
+} // namespace PylonToMQTT
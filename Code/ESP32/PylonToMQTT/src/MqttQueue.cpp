@@ -0,0 +1,93 @@
+#include "Log.h"
+#include "Metrics.h"
+#include "MqttQueue.h"
+
+namespace PylonToMQTT
+{
+	// eviction order, a message can only displace messages of the same or an earlier class in this list
+	const PublishPriority _evictionOrder[] = {ReadingsPriority, LogPriority, DiscoveryPriority, AlarmPriority};
+
+	bool MqttQueue::Push(PublishPriority priority, const char *topic, const char *payload, bool retained, uint32_t sampleMillis, uint8_t bank)
+	{
+		size_t size = strlen(topic) + strlen(payload);
+		if (priority == ReadingsPriority)
+		{
+			std::deque<QueuedMessage> &readings = _queues[priority];
+			for (auto it = readings.begin(); it != readings.end(); ++it)
+			{
+				if (it->Topic == topic) // superseded by the newer reading
+				{
+					_bytes -= it->Topic.size() + it->Payload.size();
+					_count--;
+					readings.erase(it);
+					_metrics.QueueCoalesced++;
+					break;
+				}
+			}
+		}
+		while (_count >= MQTT_QUEUE_SIZE || _bytes + size > MQTT_QUEUE_BYTES)
+		{
+			if (!evict(priority))
+			{
+				_metrics.QueueDrops[priority]++;
+				logw("MQTT queue full, dropped %s message %s", PublishPriorityNames[priority], topic);
+				return false;
+			}
+		}
+		_queues[priority].push_back(QueuedMessage{topic, payload, retained, priority, sampleMillis, bank});
+		_count++;
+		_bytes += size;
+		_metrics.QueueDepth = _count;
+		return true;
+	}
+
+	bool MqttQueue::evict(PublishPriority priority)
+	{
+		for (PublishPriority candidate : _evictionOrder)
+		{
+			if (!_queues[candidate].empty())
+			{
+				QueuedMessage &oldest = _queues[candidate].front();
+				_bytes -= oldest.Topic.size() + oldest.Payload.size();
+				_count--;
+				_queues[candidate].pop_front();
+				_metrics.QueueDrops[candidate]++;
+				return true;
+			}
+			if (candidate == priority)
+			{
+				break;
+			}
+		}
+		return false;
+	}
+
+	QueuedMessage *MqttQueue::Peek()
+	{
+		for (int i = 0; i < PublishPriorityCount; i++)
+		{
+			if (!_queues[i].empty())
+			{
+				return &_queues[i].front();
+			}
+		}
+		return NULL;
+	}
+
+	void MqttQueue::Pop()
+	{
+		for (int i = 0; i < PublishPriorityCount; i++)
+		{
+			if (!_queues[i].empty())
+			{
+				QueuedMessage &message = _queues[i].front();
+				_bytes -= message.Topic.size() + message.Payload.size();
+				_count--;
+				_queues[i].pop_front();
+				break;
+			}
+		}
+		_metrics.QueueDepth = _count;
+	}
+
+} // namespace PylonToMQTT
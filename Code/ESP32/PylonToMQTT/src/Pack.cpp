@@ -1,16 +1,54 @@
 #include "Log.h"
 #include "Defines.h"
 #include "Pack.h"
+#include "StatusBits.h"
 
 namespace PylonToMQTT
 {
 
-	void Pack::PublishDiscovery()
+	void Pack::PublishInfo()
+	{
+		JsonDocument doc;
+		if (!_versionInfo.empty())
+		{
+			doc["Version"] = _versionInfo.c_str();
+		}
+		if (!_barCode.empty())
+		{
+			doc["BarCode"] = _barCode.c_str();
+		}
+		char buf[64];
+		sprintf(buf, "info/%s", _name.c_str());
+		_psi->Publish(buf, doc, false);
+		SetInfoPublished();
+	}
+
+	// retained, per pack on top of the bank's LWT so a pack removed from the bank shows unavailable
+	void Pack::PublishAvailability(bool online)
+	{
+		char buf[64];
+		sprintf(buf, "availability/%s", _name.c_str());
+		_psi->Publish(buf, online ? "Online" : "Offline", true);
+	}
+
+	// bankMessage: readings arrive as the Pack sub-object of stat/readings/bank
+	// compactStatus: status bits arrive as the Status byte array instead of the decoded groups
+	void Pack::PublishDiscovery(bool bankMessage, bool compactStatus)
 	{
 		if (ReadyToPublish())
 		{
 			logd("Publishing discovery for %s", Name().c_str());
 			char buffer[STR_LEN];
+			char jsonElement[STR_LEN];
+			char value_json[STR_LEN];
+			if (bankMessage)
+			{
+				sprintf(value_json, "value_json.%s", _name.c_str());
+			}
+			else
+			{
+				strcpy(value_json, "value_json");
+			}
 			char pack_id[STR_LEN];
 			sprintf(pack_id, "%s_%s", _psi->getSubtopicName().c_str(), _name.c_str());
 			JsonDocument doc;
@@ -33,7 +71,8 @@ namespace PylonToMQTT
 			PackVoltage["name"] = "PackVoltage";
 			PackVoltage["device_class"] = "voltage";
 			PackVoltage["unit_of_measurement"] = "V";
-			PackVoltage["value_template"] = "{{ value_json.PackVoltage.Reading }}";
+			sprintf(jsonElement, "{{ %s.PackVoltage.Reading }}", value_json);
+			PackVoltage["value_template"] = jsonElement;
 			sprintf(buffer, "%s_PackVoltage", pack_id);
 			PackVoltage["unique_id"] = buffer;
 			PackVoltage["icon"] = "mdi:lightning-bolt";
@@ -43,7 +82,8 @@ namespace PylonToMQTT
 			PackCurrent["name"] = "PackCurrent";
 			PackCurrent["device_class"] = "current";
 			PackCurrent["unit_of_measurement"] = "A";
-			PackCurrent["value_template"] = "{{ value_json.PackCurrent.Reading }}";
+			sprintf(jsonElement, "{{ %s.PackCurrent.Reading }}", value_json);
+			PackCurrent["value_template"] = jsonElement;
 			sprintf(buffer, "%s_PackCurrent", pack_id);
 			PackCurrent["unique_id"] = buffer;
 			PackCurrent["icon"] = "mdi:current-dc";
@@ -53,7 +93,8 @@ namespace PylonToMQTT
 			SOC["name"] = "SOC";
 			SOC["device_class"] = "battery";
 			SOC["unit_of_measurement"] = "%";
-			SOC["value_template"] = "{{ value_json.SOC }}";
+			sprintf(jsonElement, "{{ %s.SOC }}", value_json);
+			SOC["value_template"] = jsonElement;
 			sprintf(buffer, "%s_SOC", pack_id);
 			SOC["unique_id"] = buffer;
 
@@ -61,17 +102,17 @@ namespace PylonToMQTT
 			RemainingCapacity["platform"] = "sensor";
 			RemainingCapacity["name"] = "RemainingCapacity";
 			RemainingCapacity["unit_of_measurement"] = "Ah";
-			RemainingCapacity["value_template"] = "{{ value_json.RemainingCapacity }}";
+			sprintf(jsonElement, "{{ %s.RemainingCapacity }}", value_json);
+			RemainingCapacity["value_template"] = jsonElement;
 			sprintf(buffer, "%s_RemainingCapacity", pack_id);
 			RemainingCapacity["unique_id"] = buffer;
 			RemainingCapacity["icon"] = "mdi:ev-station";
 
-			char jsonElement[STR_LEN];
 			for (int i = 0; i < _numberOfTemps; i++)
 			{
 				if (i < _pTempKeys->size())
 				{
-					sprintf(jsonElement, "{{ value_json.Temps.%s.Reading }}", _pTempKeys->at(i).c_str());
+					sprintf(jsonElement, "{{ %s.Temps.%s.Reading }}", value_json, _pTempKeys->at(i).c_str());
 					JsonObject TMP = components[_pTempKeys->at(i).c_str()].to<JsonObject>();
 					TMP["platform"] = "sensor";
 					TMP["name"] = _pTempKeys->at(i).c_str();
@@ -87,7 +128,7 @@ namespace PylonToMQTT
 			for (int i = 0; i < _numberOfCells; i++)
 			{
 				sprintf(entityName, "Cell_%d", i + 1);
-				sprintf(jsonElement, "{{ value_json.Cells.Cell_%d.Reading }}", i + 1);
+				sprintf(jsonElement, "{{ %s.Cells.Cell_%d.Reading }}", value_json, i + 1);
 				JsonObject CELL = components[entityName].to<JsonObject>();
 				CELL["platform"] = "sensor";
 				CELL["name"] = entityName;
@@ -99,13 +140,60 @@ namespace PylonToMQTT
 				CELL["icon"] = "mdi:lightning-bolt";
 			}
 
-			sprintf(buffer, "%s/stat/readings/%s", _psi->getRootTopicPrefix().c_str(), _name.c_str());
+			// one problem sensor per alarm group, the masks come from the same StatusBits table as the readings
+			const char *groupName = NULL;
+			for (int i = 0; i < STATUS_BIT_COUNT; i++)
+			{
+				const StatusBit &sb = StatusBits[i];
+				if (!IsAlarmBit(sb) || (groupName != NULL && strcmp(sb.Group, groupName) == 0))
+				{
+					continue;
+				}
+				groupName = sb.Group;
+				uint8_t masks[StatusRegisterCount] = {};
+				for (int j = i; j < STATUS_BIT_COUNT && strcmp(StatusBits[j].Group, groupName) == 0; j++)
+				{
+					masks[StatusBits[j].Register] |= 1 << StatusBits[j].Bit;
+				}
+				if (compactStatus)
+				{
+					std::string test;
+					for (int r = 0; r < StatusRegisterCount; r++)
+					{
+						if (masks[r] != 0)
+						{
+							sprintf(buffer, "%s(%s.Status[%d] | bitwise_and(%d)) > 0", test.empty() ? "" : " or ", value_json, r, masks[r]);
+							test += buffer;
+						}
+					}
+					snprintf(jsonElement, sizeof(jsonElement), "{{ 'ON' if %s else 'OFF' }}", test.c_str());
+				}
+				else
+				{
+					snprintf(jsonElement, sizeof(jsonElement), "{{ 'ON' if %s.%s.values() | select | list | count > 0 else 'OFF' }}", value_json, groupName);
+				}
+				JsonObject STATUS = components[groupName].to<JsonObject>();
+				STATUS["platform"] = "binary_sensor";
+				STATUS["name"] = groupName;
+				STATUS["device_class"] = "problem";
+				STATUS["value_template"] = jsonElement;
+				sprintf(buffer, "%s_%s", pack_id, groupName);
+				STATUS["unique_id"] = buffer;
+			}
+
+			sprintf(buffer, "%s/stat/readings/%s", _psi->getRootTopicPrefix().c_str(), bankMessage ? "bank" : _name.c_str());
 			doc["state_topic"] = buffer;
-			sprintf(buffer, "%s/tele/LWT", _psi->getRootTopicPrefix().c_str());
-			doc["availability_topic"] = buffer;
+			JsonArray availability = doc["availability"].to<JsonArray>();
+			JsonObject bank = availability.add<JsonObject>();
+			bank["topic"] = _psi->getWillTopic();
+			JsonObject pack = availability.add<JsonObject>();
+			sprintf(buffer, "%s/stat/availability/%s", _psi->getRootTopicPrefix().c_str(), _name.c_str());
+			pack["topic"] = buffer;
+			doc["availability_mode"] = "all";
 			doc["pl_avail"] = "Online";
 			doc["pl_not_avail"] = "Offline";
 			_psi->PublishHADiscovery(pack_id, doc);
+			PublishAvailability(true);
 			_discoveryPublished = true;
 		}
 	}
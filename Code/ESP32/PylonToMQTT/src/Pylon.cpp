@@ -1,13 +1,21 @@
 #include <Arduino.h>
 #include <vector>
+#include <memory>
 #include "IotWebConfOptionalGroup.h"
 #include <IotWebConfTParameter.h>
 #include "Log.h"
 #include "WebLog.h"
+#include "Trace.h"
 #include "HelperFunctions.h"
 #include "Defines.h"
 #include "Pylon.h"
-#include <WebSocketsServer.h>
+#include "Clock.h"
+#include "ReadingsJson.h"
+#include "StatusBits.h"
+#include "WebDashboard.h"
+#include "WebApi.h"
+#include "ModbusServer.h"
+#include "Benchmark.h"
 #include <ESPAsyncWebServer.h>
 #include <AsyncTCP.h>
 #include "html.h"
@@ -16,33 +24,80 @@ namespace PylonToMQTT
 {
 	WebLog _webLog = WebLog();
 	AsyncWebServer asyncServer(ASYNC_WEBSERVER_PORT);
-	WebSocketsServer _webSocket = WebSocketsServer(WSOCKET_HOME_PORT);
+	WebDashboard _dashboard = WebDashboard();
+	WebApi _webApi = WebApi();
+	ModbusServer _modbusServer = ModbusServer();
+	IotWebConfParameterGroup pylonGroup = IotWebConfParameterGroup("pylon", "Battery");
+	iotwebconf::CheckboxTParameter bankMessageParam = iotwebconf::Builder<iotwebconf::CheckboxTParameter>("bankMessage").label("Publish each bank cycle as one readings/bank message").defaultValue(false).build();
+	iotwebconf::CheckboxTParameter compactStatusParam = iotwebconf::Builder<iotwebconf::CheckboxTParameter>("compactStatus").label("Publish status bits as integers, decoded only on change").defaultValue(false).build();
 
-	CommandInformation _infoCommands[] = {CommandInformation::GetVersionInfo, CommandInformation::GetBarCode, CommandInformation::None};
-	CommandInformation _readingsCommands[] = {CommandInformation::AnalogValueFixedPoint, CommandInformation::AlarmInfo, CommandInformation::None};
+	void Pylon::begin(IOTServiceInterface *pcb, uint8_t bank, HardwareSerial *serial, int8_t rxPin, int8_t txPin)
+	{
+		_psi = pcb;
+		_bank = bank;
+		_bankMessage = bankMessageParam.value();
+		_compactStatus = compactStatusParam.value();
+		loadTopology();
+		_metrics.AddBank(_psi->getSubtopicName(), &_counters, &_bankReadings);
+		serial->begin(BAUDRATE, SERIAL_8N1, rxPin, txPin);
+		while (!*serial) {}
+		Start(serial);
+		char name[16];
+		sprintf(name, "publish%d", _bank + 1);
+		xTaskCreatePinnedToCore(publishTask, name, 8192, this, tskIDLE_PRIORITY + 1, &_publishTask, NETWORK_CORE);
+		sprintf(name, "bank%d", _bank + 1);
+		xTaskCreatePinnedToCore(task, name, 8192, this, tskIDLE_PRIORITY + 2, &_task, BUS_CORE);
+	}
 
+	// polls one bank, each bank has its own task so banks are read concurrently
+	void Pylon::task(void *arg)
+	{
+		Pylon *pylon = (Pylon *)arg;
+		for (;;)
+		{
+			pylon->Step(pylon->_psi->Connected(), pylon->_psi->PublishRate(), pylon->_psi->LowPower());
+		}
+	}
 
-	Pylon::Pylon()
+	void Pylon::notifyPublisher()
 	{
-		_asyncSerial = new AsyncSerial();
-		_TempKeys = {"CellTemp1_4", "CellTemp5_8", "CellTemp9_12", "CellTemp13_16", "MOS_T", "ENV_T"};
+		if (_publishTask != NULL)
+		{
+			xTaskNotifyGive(_publishTask);
+		}
 	}
 
-	Pylon::~Pylon()
+	// publishes the bank's snapshots from the network core so TCP stalls do not hold up the bus
+	void Pylon::publishTask(void *arg)
 	{
-		delete _asyncSerial;
+		Pylon *pylon = (Pylon *)arg;
+		for (;;)
+		{
+			_clock->Wait(10); // woken by queueSnapshot, the timeout services the dashboard socket
+			if (pylon->_bank == 0)
+			{
+				_dashboard.process();
+			}
+			pylon->Publish();
+		}
 	}
 
 	String Pylon::getSettingsHTML()
 	{
-		String s;
-		s += "ToDo";
+		String s = "Battery: <ul>";
+		s += htmlConfigEntry<const char *>(bankMessageParam.label, bankMessageParam.value() ? "Yes" : "No");
+		s += htmlConfigEntry<const char *>(compactStatusParam.label, compactStatusParam.value() ? "Yes" : "No");
+		s += htmlConfigEntry<const char *>("Web page, REST API and Modbus TCP", _psi->getSubtopicName().c_str()); // first bank only, MQTT and /metrics cover every bank
+		s += "</ul>";
+		s += _latency.getSettingsHTML();
 		return s;
 	}
 
 	iotwebconf::ParameterGroup *Pylon::parameterGroup()
 	{
-		return NULL;
+		pylonGroup.addItem(&bankMessageParam);
+		pylonGroup.addItem(&compactStatusParam);
+		return &pylonGroup;
 	}
 
 	bool Pylon::validate(iotwebconf::WebRequestWrapper *webRequestWrapper)
@@ -57,436 +112,496 @@ namespace PylonToMQTT
 	void Pylon::onMqttMessage(char *topic, JsonDocument &doc)
 	{
 		logd("onMqttMessage %s", topic);
+		std::string benchmarkTopic = _psi->getRootTopicPrefix() + "/cmnd/benchmark";
+		if (benchmarkTopic == topic)
+		{
+			int iterations = doc["iterations"] | BENCHMARK_ITERATIONS;
+			if (_benchmarkRunning.exchange(true))
+			{
+				logw("Benchmark already running");
+			}
+			else
+			{
+				_benchmarkIterations = max(1, min(iterations, BENCHMARK_MAX_ITERATIONS));
+				xTaskCreatePinnedToCore(benchmarkTask, "benchmark", 8192, this, tskIDLE_PRIORITY, NULL, NETWORK_CORE);
+			}
+		}
+		std::string pollTopic = _psi->getRootTopicPrefix() + "/cmnd/poll";
+		if (pollTopic == topic)
+		{
+			PollRequest request = {};
+			int pack = doc["pack"] | 0;
+			const char *cmd = doc["cmd"] | "analog";
+			if (strcmp(cmd, "analog") == 0)
+			{
+				request.Command = CommandInformation::AnalogValueFixedPoint;
+			}
+			else if (strcmp(cmd, "alarm") == 0)
+			{
+				request.Command = CommandInformation::AlarmInfo;
+			}
+			if (pack < 1 || pack > _numberOfPacks || request.Command == CommandInformation::None) // Poll checks again against _Packs on the bus task
+			{
+				logw("Invalid poll, expected {\"pack\":1..%d,\"cmd\":\"analog\"|\"alarm\",\"id\":\"optional\"}", _numberOfPacks);
+				return;
+			}
+			request.Pack = pack;
+			if (doc["id"].is<const char *>())
+			{
+				strlcpy(request.Id, doc["id"], sizeof(request.Id));
+			}
+			else if (doc["id"].is<long>())
+			{
+				snprintf(request.Id, sizeof(request.Id), "%ld", doc["id"].as<long>());
+			}
+			else
+			{
+				snprintf(request.Id, sizeof(request.Id), "Pack%d", request.Pack);
+			}
+			for (char *p = request.Id; *p; p++)
+			{
+				if (*p == '/' || *p == '+' || *p == '#')
+				{
+					*p = '_'; // keep the response on a single subtopic
+				}
+			}
+			if (!_polls.Push(request))
+			{
+				logw("Poll queue full, dropped poll of Pack%d", request.Pack);
+			}
+			else if (_task != NULL)
+			{
+				xTaskNotifyGive(_task);
+			}
+		}
+		std::string captureTopic = _psi->getRootTopicPrefix() + "/cmnd/capture";
+		if (captureTopic == topic)
+		{
+			requestCapture(doc["pack"] | 0, doc["seconds"] | CAPTURE_DEFAULT_SECONDS);
+		}
+	}
+
+	// queues a burst capture, the MQTT and web server callbacks both run on the async_tcp task so the queue keeps a single producer
+	bool Pylon::requestCapture(int pack, int seconds)
+	{
+		if (pack < 1 || pack > MAX_PACKS || seconds < 1 || seconds > CAPTURE_MAX_SECONDS)
+		{
+			logw("Invalid capture, expected {\"pack\":n,\"seconds\":1..%d}", CAPTURE_MAX_SECONDS);
+			return false;
+		}
+		CaptureRequest request = {};
+		request.Pack = pack;
+		request.Seconds = seconds;
+		if (!_captures.Push(request))
+		{
+			logw("Capture queue full, dropped capture of Pack%d", pack);
+			return false;
+		}
+		if (_task != NULL)
+		{
+			xTaskNotifyGive(_task);
+		}
+		return true;
 	}
 
 	void Pylon::onWiFiConnect()
 	{
 		asyncServer.begin();
 		_webLog.begin(&asyncServer);
-		_webSocket.begin();
-		_webSocket.onEvent([](uint8_t num, WStype_t type, uint8_t *payload, size_t length)
-						   { 
-			if (type == WStype_DISCONNECTED)
-			{
-				logi("[%u] Home Page Disconnected!\n", num);
-			}
-			else if (type == WStype_CONNECTED)
-			{
-				logi("[%u] Home Page Connected!\n", num);
-			} });
+		_dashboard.begin();
+		_webApi.begin(&asyncServer);
+		_metrics.begin(&asyncServer);
+		_modbusServer.begin();
 
 		asyncServer.on("/", HTTP_GET, [this](AsyncWebServerRequest *request) {
 			String page = home_html;
 			page.replace("{n}", _psi->getThingName().c_str());
 			page.replace("{v}", CONFIG_VERSION);
 			page.replace("{cp}", String(IOTCONFIG_PORT));
+			page.replace("{hp}", String(WSOCKET_HOME_PORT));
 
 			request->send(200, "text/html", page);
 		});
+		asyncServer.on("/api/capture", HTTP_POST, [this](AsyncWebServerRequest *request) {
+			int pack = request->hasParam("pack") ? request->getParam("pack")->value().toInt() : 0;
+			int seconds = request->hasParam("seconds") ? request->getParam("seconds")->value().toInt() : CAPTURE_DEFAULT_SECONDS;
+			if (!requestCapture(pack, seconds))
+			{
+				request->send(400, "application/json", "{\"error\":\"expected pack and seconds, or a capture is already queued\"}");
+				return;
+			}
+			char body[96];
+			snprintf(body, sizeof(body), "{\"topic\":\"%s/stat/capture/Pack%d\"}", _psi->getRootTopicPrefix().c_str(), pack);
+			request->send(202, "application/json", body);
+		});
 	}
 
 	void Pylon::Process()
 	{
-		_webLog.process();
-		_webSocket.loop();
 		return;
 	}
 
-	bool Pylon::Transmit()
+	// runs on spare cycles of the network core, the scratch Pylon has its own counters and histograms
+	void Pylon::benchmarkTask(void *arg)
 	{
-		bool sequenceComplete = false;
-		if (_numberOfPacks == 0)
-		{
-			_root.clear();
-			send_cmd(0xFF, CommandInformation::GetPackCount);
-		}
-		else
+		Pylon *pylon = (Pylon *)arg;
+		JsonDocument doc;
+		std::unique_ptr<Benchmark> benchmark(new Benchmark(pylon->_psi));
+		benchmark->Run(pylon->_benchmarkIterations, doc);
+		benchmark.reset();
+		pylon->_psi->Publish("benchmark", doc, false);
+		pylon->_benchmarkRunning = false;
+		vTaskDelete(NULL);
+	}
+
+	// network core, drains the snapshots queued by the bus engine
+	void Pylon::Publish()
+	{
+		PackSnapshot snapshot;
+		while (_snapshots.Pop(snapshot))
 		{
-			_psi->Online(); // ensure online status is published now that we have a pack count
-			if (_currentPack < _Packs.size())
+			if (snapshot.PackCount > 0)
 			{
-				if (_Packs[_currentPack].InfoPublished() == false)
-				{
-					if (_infoCommands[_infoCommandIndex] != CommandInformation::None)
-					{
-						send_cmd(_currentPack + 1, _infoCommands[_infoCommandIndex]);
-					}
-					else
-					{
-						if (_root.size() > 0)
-						{
-							String s;
-							serializeJson(_root, s);
-							_root.clear();
-							char buf[64];
-							sprintf(buf, "info/Pack%d", _currentPack + 1);
-							_psi->Publish(buf, s.c_str(), false);
-							_Packs[_currentPack].SetInfoPublished();
-						}
-					}
-					_infoCommandIndex++;
-					if (_infoCommandIndex == sizeof(_infoCommands))
-					{
-						_infoCommandIndex = 0;
-						_currentPack++;
-						if (_currentPack == _numberOfPacks)
-						{
-							_currentPack = 0;
-							sequenceComplete = true;
-						}
-					}
-				}
-				else
-				{
-					if (_readingsCommands[_readingsCommandIndex] != CommandInformation::None)
-					{
-						send_cmd(_currentPack + 1, _readingsCommands[_readingsCommandIndex]);
-					}
-					else
-					{
-						if (_root.size() > 0)
-						{
-							_Packs[_currentPack].PublishDiscovery(); // PublishDiscovery if ready and not already published
-							String s;
-							serializeJson(_root, s);
-							_root.clear();
-							char buf[64];
-							sprintf(buf, "readings/Pack%d", _currentPack + 1);
-							_psi->Publish(buf, s.c_str(), false);
-						}
-					}
-					_readingsCommandIndex++;
-					if (_readingsCommandIndex == sizeof(_readingsCommands))
-					{
-						_readingsCommandIndex = 0;
-						_currentPack++;
-						if (_currentPack == _numberOfPacks)
-						{
-							_currentPack = 0;
-							sequenceComplete = true;
-						}
-					}
-				}
+				_psi->Online(); // ensure online status is published now that we have a pack count
+			}
+			if (snapshot.Topology != NoTopology)
+			{
+				publishTopology(snapshot);
+				continue;
+			}
+			if (snapshot.Event)
+			{
+				publishEvent(snapshot);
+				continue;
+			}
+			if (snapshot.Poll != CommandInformation::None)
+			{
+				publishPoll(snapshot);
+				continue;
+			}
+			if (snapshot.Sections != 0)
+			{
+				publishReadings(snapshot);
+			}
+			if (snapshot.SequenceComplete && _bankDoc.size() > 0)
+			{
+				publishBank();
+			}
+			if (snapshot.SequenceComplete)
+			{
+				_counters.DataAgeMaxMillis = _counters.DataAgeCycleMillis.exchange(0);
+			}
+			if (snapshot.SequenceComplete && _bank == 0)
+			{
+				ReadBank(_view);
+				_webApi.Commit(_view.PackCount);
+				_metrics.Render(_TempKeys); // every bank, on the first bank's cycle
+			}
+			if (snapshot.SequenceComplete && _clock->Millis() - _lastDiagTimeStamp > DIAG_PUBLISH_RATE)
+			{
+				JsonDocument doc;
+				_latency.Report(doc);
+				_psi->Publish("diag", doc, false); // each bank on its own diag topic
+				_latency.Reset();
+				_lastDiagTimeStamp = _clock->Millis();
 			}
 		}
-		return sequenceComplete;
+		if (_captureReady)
+		{
+			publishCapture();
+		}
 	}
 
-	uint16_t Pylon::get_frame_checksum(char *frame)
+	void Pylon::publishTopology(const PackSnapshot &snapshot)
 	{
-		uint16_t sum = 0;
-		uint16_t len = strlen(frame);
-		for (int i = 0; i < len; i++)
+		char name[STR_LEN];
+		sprintf(name, "Pack%d", snapshot.Pack + 1);
+		Pack pack(name, &_TempKeys, _psi);
+		pack.setVersionInfo(snapshot.Version);
+		pack.setBarcode(snapshot.BarCode);
+		pack.setNumberOfCells(snapshot.Cells);
+		pack.setNumberOfTemps(snapshot.Temps);
+		pack.SetInfoPublished(); // the bus engine sequences info before discovery
+		switch (snapshot.Topology)
 		{
-			sum += frame[i];
+		case InfoMessage:
+			pack.PublishInfo();
+			break;
+		case DiscoveryMessage:
+			pack.PublishDiscovery(_bankMessage, _compactStatus);
+			break;
+		case OfflineMessage:
+			pack.PublishAvailability(false);
+			break;
 		}
-		sum = ~sum;
-		sum %= 0x10000;
-		sum += 1;
-		return sum;
 	}
 
-	int Pylon::get_info_length(const char *info)
+	// one message per capture on stat/capture/PackN, columns in protocol units to keep it compact
+	// {"Pack":1,"Start":<uptime ms>,"Samples":n,"Missed":0,"Timestamp":<epoch ms>,"Time":[ms..],"Voltage":[mV..],"Current":[cA..]}
+	void Pylon::publishCapture()
 	{
-		size_t lenid = strlen(info);
-		if (lenid == 0)
-			return 0;
-		int lenid_sum = (lenid & 0xf) + ((lenid >> 4) & 0xf) + ((lenid >> 8) & 0xf);
-		int lenid_modulo = lenid_sum % 16;
-		int lenid_invert_plus_one = 0b1111 - lenid_modulo + 1;
-		return (lenid_invert_plus_one << 12) + lenid;
+		char buf[96];
+		snprintf(buf, sizeof(buf), "{\"Pack\":%d,\"Start\":%lu,\"Samples\":%d,\"Missed\":%d", _capture.Pack, (unsigned long)_captureStart, (int)_captureSamples.size(), _captureMissed);
+		String s;
+		s.reserve(64 + _captureSamples.size() * 20);
+		s += buf;
+		if (_captureEpochMillis != 0)
+		{
+			snprintf(buf, sizeof(buf), ",\"Timestamp\":%llu", (unsigned long long)_captureEpochMillis);
+			s += buf;
+		}
+		s += ",\"Time\":[";
+		for (size_t i = 0; i < _captureSamples.size(); i++)
+		{
+			if (i > 0)
+			{
+				s += ',';
+			}
+			s += _captureSamples[i].Millis;
+		}
+		s += "],\"Voltage\":[";
+		for (size_t i = 0; i < _captureSamples.size(); i++)
+		{
+			if (i > 0)
+			{
+				s += ',';
+			}
+			s += _captureSamples[i].VoltageMillivolts;
+		}
+		s += "],\"Current\":[";
+		for (size_t i = 0; i < _captureSamples.size(); i++)
+		{
+			if (i > 0)
+			{
+				s += ',';
+			}
+			s += _captureSamples[i].CurrentCentiamps;
+		}
+		s += "]}";
+		sprintf(buf, "capture/Pack%d", _capture.Pack);
+		_psi->Publish(buf, s.c_str(), false);
+		logi("Capture of Pack%d published, %d samples", _capture.Pack, _captureSamples.size());
+		_captureSamples.clear();
+		_captureSamples.shrink_to_fit(); // only hold the buffer while capturing
+		_captureReady = false;
 	}
 
-	void Pylon::encode_cmd(char *frame, uint8_t address, uint8_t cid2, const char *info)
+	void Pylon::publishReadings(const PackSnapshot &snapshot)
 	{
-		char sub_frame[64];
-		uint8_t cid1 = 0x46;
-		sprintf(sub_frame, "%02X%02X%02X%02X%04X", 0x25, address, cid1, cid2, get_info_length(info));
-		strcat(sub_frame, info);
-		sprintf(frame, "~%s%04X\r", sub_frame, get_frame_checksum(sub_frame));
-		return;
+		ReadBank(_view); // written by the bus task before it queued the snapshot
+		char buf[64];
+		sprintf(buf, "Pack%d", snapshot.Pack + 1);
+		JsonDocument doc;
+		if (_bankMessage && _bankDoc.size() == 0)
+		{
+			_bankDoc["Sequence"] = _bankSequence;
+			_bankSampleMillis = _view.SampleMillis[snapshot.Pack];
+		}
+		JsonObject readings = _bankMessage ? _bankDoc[buf].to<JsonObject>() : doc.to<JsonObject>();
+		bool decodeStatus = true;
+		if (_compactStatus && (snapshot.Sections & AlarmSection))
+		{
+			uint8_t *last = _lastStatus[snapshot.Pack];
+			decodeStatus = !(_statusKnown & (1 << snapshot.Pack)) || memcmp(last, _view.Status[snapshot.Pack], StatusRegisterCount) != 0;
+			memcpy(last, _view.Status[snapshot.Pack], StatusRegisterCount);
+			_statusKnown |= 1 << snapshot.Pack;
+		}
+		uint32_t start = _latency.Start();
+		BuildReadings(readings, _view, snapshot.Pack, snapshot.Sections, _TempKeys, _compactStatus, decodeStatus);
+		_latency.Stop(JsonBuildStage, start);
+		String s;
+		start = _latency.Start();
+		serializeJson(readings, s);
+		_latency.Stop(SerializeStage, start);
+		if (!_bankMessage)
+		{
+			sprintf(buf, "readings/Pack%d", snapshot.Pack + 1);
+			start = _latency.Start();
+			_psi->Publish(buf, s.c_str(), false, _view.SampleMillis[snapshot.Pack]);
+			_latency.Stop(PublishStage, start);
+			logt(PUBLISH_READINGS, snapshot.Pack + 1, s.length());
+		}
+		if (_bank == 0)
+		{
+			_dashboard.Update(_view);
+			if (decodeStatus)
+			{
+				_webApi.UpdatePack(snapshot.Pack, s);
+			}
+			else // the REST snapshot replaces the whole pack, so splice the decoded status groups into the compact payload
+			{
+				JsonDocument groups;
+				AddStatusGroups(groups.to<JsonObject>(), _view.Status[snapshot.Pack]);
+				String g;
+				serializeJson(groups, g);
+				String w = s.substring(0, s.length() - 1); // compact payload without its closing brace, holds at least Status
+				w += ',';
+				w += g.c_str() + 1; // groups without their opening brace
+				_webApi.UpdatePack(snapshot.Pack, w);
+			}
+			_modbusServer.Update(_view);
+		}
 	}
 
-	void Pylon::send_cmd(uint8_t address, CommandInformation cmd)
+	// one message for the whole bank cycle, {"Sequence":n,"Pack1":{..},"Pack2":{..}}
+	void Pylon::publishBank()
 	{
-		_currentCommand = cmd;
-		char raw_frame[64];
-		memset(raw_frame, 0, 64);
-		char bdevid[4];
-		sprintf(bdevid, "%02X", address);
-		encode_cmd(raw_frame, address, cmd, bdevid);
-		logd("send_cmd: %s", raw_frame);
-		_asyncSerial->Send(cmd, (byte *)raw_frame, strlen(raw_frame));
+		String s;
+		uint32_t start = _latency.Start();
+		serializeJson(_bankDoc, s);
+		_latency.Stop(SerializeStage, start);
+		_bankDoc.clear();
+		_bankSequence++;
+		start = _latency.Start();
+		_psi->Publish("readings/bank", s.c_str(), false, _bankSampleMillis);
+		_latency.Stop(PublishStage, start);
+		logt(PUBLISH_READINGS, TRACE_BANK, s.length());
 	}
 
-	String Pylon::convert_ASCII(char *p)
+	// retained on stat/event, {"Pack":1,"Raised":["Protect_Status.Cell_OVP"],"Cleared":[],"Active":["Protect_Status.Cell_OVP"]}
+	void Pylon::publishEvent(const PackSnapshot &snapshot)
 	{
-		String ascii = "";
-		String hex = p;
-		for (size_t i = 0; i < strlen(p); i += 2)
+		JsonDocument doc;
+		doc["Pack"] = snapshot.Pack + 1;
+		if (snapshot.SampleEpochMillis != 0)
 		{
-			String part = hex.substring(i, 2);
-			ascii += strtol(part.c_str(), nullptr, 16);
+			doc["Timestamp"] = snapshot.SampleEpochMillis;
 		}
-		return ascii;
+		JsonArray raised = doc["Raised"].to<JsonArray>();
+		JsonArray cleared = doc["Cleared"].to<JsonArray>();
+		JsonArray active = doc["Active"].to<JsonArray>();
+		char name[48];
+		for (int i = 0; i < STATUS_BIT_COUNT; i++)
+		{
+			const StatusBit &sb = StatusBits[i];
+			if (!IsAlarmBit(sb))
+			{
+				continue;
+			}
+			bool now = CheckBit(snapshot.Status[sb.Register], sb.Bit);
+			bool was = CheckBit(snapshot.PreviousStatus[sb.Register], sb.Bit);
+			sprintf(name, "%s.%s", sb.Group, sb.Name);
+			if (now && !was)
+			{
+				raised.add(name);
+			}
+			if (!now && was)
+			{
+				cleared.add(name);
+			}
+			if (now)
+			{
+				active.add(name);
+			}
+		}
+		logw("Pack%d alarm bits changed, %d active", snapshot.Pack + 1, active.size());
+		_psi->Publish("event", doc, true);
 	}
 
-	unsigned char parse_hex(char c)
+	// the requested section of the readings/PackN payload on stat/poll/<id>, or an error when the pack did not answer
+	void Pylon::publishPoll(const PackSnapshot &snapshot)
 	{
-		if ('0' <= c && c <= '9')
-			return c - '0';
-		if ('A' <= c && c <= 'F')
-			return c - 'A' + 10;
-		if ('a' <= c && c <= 'f')
-			return c - 'a' + 10;
-		return 0;
+		JsonDocument doc;
+		JsonObject response = doc.to<JsonObject>();
+		response["Pack"] = snapshot.Pack + 1;
+		if (snapshot.Sections == 0)
+		{
+			response["Error"] = "No response";
+		}
+		else
+		{
+			ReadBank(_view);
+			BuildReadings(response, _view, snapshot.Pack, snapshot.Sections, _TempKeys, _compactStatus);
+		}
+		char buf[64];
+		snprintf(buf, sizeof(buf), "poll/%s", snapshot.PollId);
+		_psi->Publish(buf, doc, false);
+		if (_bank == 0 && snapshot.Sections != 0)
+		{
+			_dashboard.Update(_view);
+			_modbusServer.Update(_view);
+		}
 	}
 
-	std::vector<unsigned char> parse_string(const std::string &s)
+	String Pylon::topologyNamespace()
 	{
-		size_t size = s.size();
-		if (size % 2 != 0)
-			size++;
-		std::vector<unsigned char> result(size / 2);
-		for (std::size_t i = 0; i != size / 2; ++i)
-			result[i] = 16 * parse_hex(s[2 * i]) + parse_hex(s[2 * i + 1]);
-		return result;
+		String name = "topology";
+		if (_bank > 0)
+		{
+			name += _bank + 1; // topology2..
+		}
+		return name;
 	}
 
-	int Pylon::ParseResponse(char *szResponse, size_t readNow, CommandInformation cmd)
+	void Pylon::loadTopology()
 	{
-		if (readNow > 0 && szResponse[0] != '\0')
+		if (!_preferences.begin(topologyNamespace().c_str(), true))
 		{
-			logd("received: %d", readNow);
-			logd("data: %s", szResponse);
-			std::string chksum;
-			chksum.assign(&szResponse[readNow - 4]);
-			std::vector<unsigned char> cs = parse_string(chksum);
-			int i = 0;
-			uint16_t CHKSUM = toShort(i, cs);
-			uint16_t sum = 0;
-			for (int i = 1; i < readNow - 4; i++)
-			{
-				sum += szResponse[i];
-			}
-			if (((CHKSUM + sum) & 0xFFFF) != 0)
+			logd("No cached topology");
+			return;
+		}
+		uint8_t count = _preferences.getUChar("count", 0);
+		if (count > 0 && count <= MAX_PACKS && _preferences.getString("cfg", "") == CONFIG_VERSION)
+		{
+			createPacks(count);
+			char key[8];
+			for (int i = 0; i < count; i++)
 			{
-				uint16_t c = ~sum + 1;
-				loge("Checksum failed: %04x, should be: %04X", sum, c);
-				return -1;
+				Pack &pack = _Packs[i];
+				sprintf(key, "c%d", i + 1);
+				pack.setNumberOfCells(_preferences.getUChar(key, 0));
+				sprintf(key, "t%d", i + 1);
+				pack.setNumberOfTemps(_preferences.getUChar(key, 0));
+				sprintf(key, "b%d", i + 1);
+				pack.setBarcode(_preferences.getString(key, "").c_str());
+				sprintf(key, "v%d", i + 1);
+				pack.setVersionInfo(_preferences.getString(key, "").c_str());
 			}
+			_numberOfPacks = count;
+			_validationSteps = 1 + count * 2;
+			logi("Restored topology of %d packs from NVS", count);
+		}
+		_preferences.end();
+	}
 
-			std::string frame;
-			frame.assign(&szResponse[1]); // skip SOI (~)
-			std::vector<unsigned char> v = parse_string(frame);
-			int index = 0;
-			uint16_t VER = v[index++];
-			uint16_t ADR = v[index++];
-			uint16_t CID1 = v[index++];
-			uint16_t CID2 = v[index++];
-			uint16_t LENGTH = toShort(index, v);
-			uint16_t LCHKSUM = LENGTH & 0xF000;
-			uint16_t LENID = LENGTH & 0x0FFF;
-			if (readNow < (LENID + 17))
-			{
-				loge("Data length error LENGTH: %04X LENID: %04X, Received: %d", LENGTH, LENID, (readNow - 17));
-				return -1;
-			}
-			logd("VER: %02X, ADR: %02X, CID1: %02X, CID2: %02X, LENID: %02X (%d), CHKSUM: %02X", VER, ADR, CID1, CID2, LENID, LENID, CHKSUM);
-			if (CID2 != ResponseCode::Normal)
-			{
-				loge("CID2 error code: %02X", CID2);
-				return -1;
-			}
-			switch (cmd)
-			{
-			case CommandInformation::AnalogValueFixedPoint:
-			{
-				uint16_t INFO = toShort(index, v);
-				uint16_t packNumber = INFO & 0x00FF;
-				logi("AnalogValueFixedPoint: INFO: %04X, Pack: %d", INFO, packNumber);
-				 JsonObject cells = _root["Cells"].to<JsonObject>();
-				char key[16];
-				uint16_t numberOfCells = v[index++];
-				for (int i = 0; i < numberOfCells; i++)
-				{
-					sprintf(key, "Cell_%d", i + 1);
-					JsonObject cell = cells[key].to<JsonObject>();
-					cell["Reading"] = (toShort(index, v)) / 1000.0;
-					cell["State"] = 0xF0;
-				}
-				JsonObject temps = _root["Temps"].to<JsonObject>();
-				uint16_t numberOfTemps = v[index++];
-				for (int i = 0; i < numberOfTemps; i++)
-				{
-					if (i < _TempKeys.size())
-					{
-						JsonObject temp = temps[_TempKeys[i]].to<JsonObject>();
-						float kelvin = (toShort(index, v))-2730.0; // use 273.0 instead of 273.15 to match jakiper app
-						temp["Reading"] = round(kelvin) / 10.0;   // limit to one decimal place
-						temp["State"] = 0;						   // default to ok
-					}
-				}
-				int packIndex = packNumber - 1;
-				logd("AnalogValueFixedPoint: packIndex: %d, Pack size: %d", packIndex, _Packs.size());
-				if (packIndex < _Packs.size())
-				{
-					_Packs[packIndex].setNumberOfCells(numberOfCells);
-					_Packs[packIndex].setNumberOfTemps(numberOfTemps);
-				}
-				JsonObject PackCurrent = _root["PackCurrent"].to<JsonObject>();
-				float current = ((int16_t)toShort(index, v)) / 100.0;
-				PackCurrent["Reading"] = current;
-				PackCurrent["State"] = 0; // default to ok
-				JsonObject PackVoltage = _root["PackVoltage"].to<JsonObject>();
-				float voltage = (toShort(index, v)) / 1000.0;
-				PackVoltage["Reading"] = voltage;
-				PackVoltage["State"] = 0; // default to ok
-				int remain = toShort(index, v);
-				_root["RemainingCapacity"] = (remain / 100.0);
-				index++; // skip user def code
-				int total = toShort(index, v);
-				_root["FullCapacity"] = (total / 100.0);
-				_root["CycleCount"] = ((v[index++] << 8) | v[index++]);
-				_root["SOC"] = (remain * 100) / total;
-				_root["Power"] = round(voltage * current);
-				// module["LAST"] = ((v[index++]<<8) | (v[index++]<<8) | v[index++]);
-			}
-			break;
-			case CommandInformation::GetVersionInfo:
-			{
-				std::string ver;
-				std::string s(v.begin(), v.end());
-				ver = s.substr(index);
-				_root["Version"] = ver.substr(0, 19);
-				int packIndex = ADR - 1;
-				if (packIndex < _Packs.size())
-				{
-					_Packs[packIndex].setVersionInfo(ver);
-				}
-			}
-			break;
-			case CommandInformation::AlarmInfo:
-			{
-				uint16_t INFO = toShort(index, v);
-				uint16_t packNumber = INFO & 0x00FF;
-				JsonObject cells = _root["Cells"].as<JsonObject>();
-				logi("GetAlarm: Pack: %d", packNumber);
-				char key[16];
-				uint16_t numberOfCells = v[index++];
-				for (int i = 0; i < numberOfCells; i++)
-				{
-					sprintf(key, "Cell_%d", i + 1);
-					JsonObject cell = cells[key].as<JsonObject>();
-					cell["State"] = v[index++];
-				}
-				JsonObject temps = _root["Temps"].as<JsonObject>();
-				uint16_t numberOfTemps = v[index++];
-				for (int i = 0; i < numberOfTemps; i++)
-				{
-					if (i < _TempKeys.size())
-					{
-						JsonObject entry = temps[_TempKeys[i]].as<JsonObject>();
-						entry["State"] = v[index++];
-					}
-				}
-				index++; // skip 65
-				JsonObject entry = _root["PackCurrent"].as<JsonObject>();
-				entry["State"] = v[index++];
-				entry = _root["PackVoltage"].as<JsonObject>();
-				entry["State"] = v[index++];
-				uint8_t ProtectSts1 = v[index++];
-				uint8_t ProtectSts2 = v[index++];
-				uint8_t SystemSts = v[index++];
-				uint8_t FaultSts = v[index++];
-				index++; // skip 81
-				index++; // skip 83
-				uint8_t AlarmSts1 = v[index++];
-				uint8_t AlarmSts2 = v[index++];
-
-				JsonObject pso = _root["Protect_Status"].to<JsonObject>();
-				pso["Charger_OVP"] = CheckBit(ProtectSts1, 7);
-				pso["SCP"] = CheckBit(ProtectSts1, 6);
-				pso["DSG_OCP"] = CheckBit(ProtectSts1, 5);
-				pso["CHG_OCP"] = CheckBit(ProtectSts1, 4);
-				pso["Pack_UVP"] = CheckBit(ProtectSts1, 3);
-				pso["Pack_OVP"] = CheckBit(ProtectSts1, 2);
-				pso["Cell_UVP"] = CheckBit(ProtectSts1, 1);
-				pso["Cell_OVP"] = CheckBit(ProtectSts1, 0);
-				pso["ENV_UTP"] = CheckBit(ProtectSts2, 6);
-				pso["ENV_OTP"] = CheckBit(ProtectSts2, 5);
-				pso["MOS_OTP"] = CheckBit(ProtectSts2, 4);
-				pso["DSG_UTP"] = CheckBit(ProtectSts2, 3);
-				pso["CHG_UTP"] = CheckBit(ProtectSts2, 2);
-				pso["DSG_OTP"] = CheckBit(ProtectSts2, 1);
-				pso["CHG_OTP"] = CheckBit(ProtectSts2, 0);
-
-				JsonObject sso = _root["System_Status"].to<JsonObject>();
-				sso["Fully_Charged"] = CheckBit(ProtectSts2, 7);
-				sso["Heater"] = CheckBit(SystemSts, 7);
-				sso["AC_in"] = CheckBit(SystemSts, 5);
-				sso["Discharge_MOS"] = CheckBit(SystemSts, 2);
-				sso["Charge_MOS"] = CheckBit(SystemSts, 1);
-				sso["Charge_Limit"] = CheckBit(SystemSts, 0);
-
-				JsonObject fso = _root["Fault_Status"].to<JsonObject>();
-				fso["Heater_Fault"] = CheckBit(FaultSts, 7);
-				fso["CCB_Fault"] = CheckBit(FaultSts, 6);
-				fso["Sampling_Fault"] = CheckBit(FaultSts, 5);
-				fso["Cell_Fault"] = CheckBit(FaultSts, 4);
-				fso["NTC_Fault"] = CheckBit(FaultSts, 2);
-				fso["DSG_MOS_Fault"] = CheckBit(FaultSts, 1);
-				fso["CHG_MOS_Fault"] = CheckBit(FaultSts, 0);
-
-				JsonObject aso = _root["Alarm_Status"].to<JsonObject>();
-				aso["DSG_OC"] = CheckBit(AlarmSts1, 5);
-				aso["CHG_OC"] = CheckBit(AlarmSts1, 4);
-				aso["Pack_UV"] = CheckBit(AlarmSts1, 3);
-				aso["Pack_OV"] = CheckBit(AlarmSts1, 2);
-				aso["Cell_UV"] = CheckBit(AlarmSts1, 1);
-				aso["Cell_OV"] = CheckBit(AlarmSts1, 0);
+	void Pylon::saveTopology()
+	{
+		_topologyDirty = false;
+		if (!_preferences.begin(topologyNamespace().c_str(), false))
+		{
+			loge("Failed to open topology NVS namespace");
+			return;
+		}
+		_preferences.clear();
+		_preferences.putString("cfg", CONFIG_VERSION);
+		_preferences.putUChar("count", _Packs.size());
+		char key[8];
+		for (int i = 0; i < _Packs.size(); i++)
+		{
+			Pack &pack = _Packs[i];
+			sprintf(key, "c%d", i + 1);
+			_preferences.putUChar(key, pack.getNumberOfCells());
+			sprintf(key, "t%d", i + 1);
+			_preferences.putUChar(key, pack.getNumberOfTemps());
+			sprintf(key, "b%d", i + 1);
+			_preferences.putString(key, pack.getBarcode().c_str());
+			sprintf(key, "v%d", i + 1);
+			_preferences.putString(key, pack.getVersionInfo().c_str());
+		}
+		_preferences.end();
+		logd("Saved topology of %d packs to NVS", _Packs.size());
+	}
 
-				aso["SOC_Low"] = CheckBit(AlarmSts2, 7);
-				aso["MOS_OT"] = CheckBit(AlarmSts2, 6);
-				aso["ENV_UT"] = CheckBit(AlarmSts2, 5);
-				aso["ENV_OT"] = CheckBit(AlarmSts2, 4);
-				aso["DSG_UT"] = CheckBit(AlarmSts2, 3);
-				aso["CHG_UT"] = CheckBit(AlarmSts2, 2);
-				aso["DSG_OT"] = CheckBit(AlarmSts2, 1);
-				aso["CHG_OT"] = CheckBit(AlarmSts2, 0);
-			}
-			break;
-			case CommandInformation::GetBarCode:
-			{
-				std::string bc;
-				std::string s(v.begin(), v.end() - 2);
-				bc = s.substr(index);
-				logi("GetBarCode for %d bc: %s", ADR, bc.c_str());
-				_root["BarCode"] = bc.substr(0, 15);
-				int packIndex = ADR - 1;
-				if (packIndex < _Packs.size())
-				{
-					_Packs[packIndex].setBarcode(bc.substr(0, 15));
-				}
-			}
-			break;
-			case CommandInformation::GetPackCount:
-			{
-				_numberOfPacks = v[index];
-				_numberOfPacks > 8 ? 1 : _numberOfPacks; // max 8, default to 1
-				_root.clear();
-				logi("GetPackCount: %d", _numberOfPacks);
-				for (int i = 0; i < _numberOfPacks; i++)
-				{
-					char packName[STR_LEN];
-					sprintf(packName, "Pack%d", i + 1);
-					_Packs.push_back(Pack(packName, &_TempKeys, _psi));
-				}
-			}
-			break;
-			}
+	String Pylon::convert_ASCII(char *p)
+	{
+		String ascii = "";
+		String hex = p;
+		for (size_t i = 0; i < strlen(p); i += 2)
+		{
+			String part = hex.substring(i, 2);
+			ascii += strtol(part.c_str(), nullptr, 16);
 		}
-		return 0;
+		return ascii;
 	}
 
 } // namespace PylonToMQTT
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "ReadingsJson.h"
+#include "Defines.h"
+#include "FixedPoint.h"
+#include "StatusBits.h"
+
+namespace PylonToMQTT
+{
+
+	void AddStatusGroups(JsonObject doc, const uint8_t *status)
+	{
+		JsonObject group;
+		const char *groupName = NULL;
+		for (int i = 0; i < STATUS_BIT_COUNT; i++)
+		{
+			const StatusBit &sb = StatusBits[i];
+			if (groupName == NULL || strcmp(sb.Group, groupName) != 0)
+			{
+				groupName = sb.Group;
+				group = doc[groupName].to<JsonObject>();
+			}
+			group[sb.Name] = CheckBit(status[sb.Register], sb.Bit);
+		}
+	}
+
+	void BuildReadings(JsonObject doc, const BankReadings &readings, uint8_t pack, uint8_t sections, const std::vector<std::string> &tempKeys, bool compactStatus, bool decodeStatus)
+	{
+		bool alarms = sections & AlarmSection;
+		if (readings.SampleEpochMillis[pack] != 0)
+		{
+			doc["Timestamp"] = readings.SampleEpochMillis[pack]; // ms since epoch at the EOI of the pack's latest frame
+		}
+		if (sections & AnalogSection)
+		{
+			JsonObject cells = doc["Cells"].to<JsonObject>();
+			char key[16];
+			for (int i = 0; i < readings.NumberOfCells[pack]; i++)
+			{
+				sprintf(key, "Cell_%d", i + 1);
+				JsonObject cell = cells[key].to<JsonObject>();
+				FixedPoint volts(readings.CellMillivolts[pack][i], 3);
+				cell["Reading"] = serialized(volts.Text, volts.Length);
+				cell["State"] = alarms ? readings.CellStates[pack][i] : 0xF0;
+			}
+			JsonObject temps = doc["Temps"].to<JsonObject>();
+			for (int i = 0; i < readings.NumberOfTemps[pack] && i < (int)tempKeys.size(); i++)
+			{
+				JsonObject temp = temps[tempKeys[i]].to<JsonObject>();
+				FixedPoint celsius(readings.TempDeciKelvin[pack][i] - 2730, 1); // use 273.0 instead of 273.15 to match jakiper app
+				temp["Reading"] = serialized(celsius.Text, celsius.Length);
+				temp["State"] = alarms ? readings.TempStates[pack][i] : 0;
+			}
+			JsonObject PackCurrent = doc["PackCurrent"].to<JsonObject>();
+			FixedPoint current(readings.CurrentCentiamps[pack], 2);
+			PackCurrent["Reading"] = serialized(current.Text, current.Length);
+			PackCurrent["State"] = alarms ? readings.CurrentState[pack] : 0;
+			JsonObject PackVoltage = doc["PackVoltage"].to<JsonObject>();
+			FixedPoint voltage(readings.VoltageMillivolts[pack], 3);
+			PackVoltage["Reading"] = serialized(voltage.Text, voltage.Length);
+			PackVoltage["State"] = alarms ? readings.VoltageState[pack] : 0;
+			FixedPoint remaining(readings.RemainingCentiamphours[pack], 2);
+			doc["RemainingCapacity"] = serialized(remaining.Text, remaining.Length);
+			FixedPoint full(readings.FullCentiamphours[pack], 2);
+			doc["FullCapacity"] = serialized(full.Text, full.Length);
+			doc["CycleCount"] = readings.CycleCount[pack];
+			doc["SOC"] = readings.SOC(pack);
+			int64_t power = (int64_t)readings.VoltageMillivolts[pack] * readings.CurrentCentiamps[pack]; // 10 uW
+			doc["Power"] = (int32_t)((power + (power < 0 ? -50000 : 50000)) / 100000); // rounded to W
+		}
+		const uint8_t *status = readings.Status[pack];
+		if (alarms && compactStatus)
+		{
+			JsonArray array = doc["Status"].to<JsonArray>(); // indexed by StatusRegister
+			for (int i = 0; i < StatusRegisterCount; i++)
+			{
+				array.add(status[i]);
+			}
+		}
+		if (alarms && (decodeStatus || !compactStatus))
+		{
+			AddStatusGroups(doc, status);
+		}
+	}
+
+} // namespace PylonToMQTT
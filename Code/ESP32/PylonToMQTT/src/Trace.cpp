@@ -0,0 +1,91 @@
+#include "Trace.h"
+
+Trace _trace;
+
+const char *const TraceFormats[] = {
+#define TRACE_EVENT_FORMAT(name, format) format,
+	TRACE_EVENTS(TRACE_EVENT_FORMAT)
+#undef TRACE_EVENT_FORMAT
+};
+
+void Trace::write(TraceEvent event, const uint32_t *args, uint8_t count)
+{
+	uint32_t sequence = _head.fetch_add(1) + 1;
+	Slot &slot = _slots[sequence % TRACE_RING_SIZE];
+	slot.Sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.Record.Sequence = sequence;
+	slot.Record.Timestamp = micros();
+	slot.Record.Event = event;
+	slot.Record.ArgCount = count;
+	memcpy(slot.Record.Args, args, count * sizeof(uint32_t));
+	slot.Sequence.store(sequence, std::memory_order_release);
+}
+
+// formats the records recorded since the last call, returns the number of characters written
+size_t Trace::Format(char *buffer, size_t size)
+{
+	uint32_t head = _head.load();
+	if (head - _tail > TRACE_RING_SIZE)
+	{
+		_tail = head - TRACE_RING_SIZE; // older records were overwritten
+	}
+	size_t len = 0;
+	char line[256];
+	while (_tail != head)
+	{
+		uint32_t sequence = _tail + 1;
+		Slot &slot = _slots[sequence % TRACE_RING_SIZE];
+		uint32_t current = slot.Sequence.load(std::memory_order_acquire);
+		if (current == 0 || current < sequence)
+		{
+			break; // still being written
+		}
+		TraceRecord record = slot.Record;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (current == sequence && slot.Sequence.load(std::memory_order_relaxed) == sequence && record.Event < TraceEventCount)
+		{
+			const char *format = TraceFormats[record.Event];
+			const uint32_t *args = record.Args;
+			if (record.Event == TRACE_PUBLISH_READINGS && args[0] == TRACE_BANK)
+			{
+				format = TRACE_BANK_FORMAT;
+				args++;
+			}
+			int n = snprintf(line, sizeof(line), "[%10u][T] ", record.Timestamp);
+			n += snprintf(&line[n], sizeof(line) - n - 1, format, args[0], args[1], args[2]);
+			n = min(n, (int)sizeof(line) - 2);
+			line[n++] = '\n';
+			if (len + n > size)
+			{
+				break; // continue with this record next time
+			}
+			memcpy(&buffer[len], line, n);
+			len += n;
+		}
+		_tail = sequence;
+	}
+	return len;
+}
+
+// copy of the valid records, oldest first, for offline decoding
+void Trace::Snapshot(std::string &out)
+{
+	uint32_t head = _head.load();
+	uint32_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE + 1 : 1;
+	out.reserve((head - first + 1) * sizeof(TraceRecord));
+	for (uint32_t sequence = first; sequence <= head; sequence++)
+	{
+		Slot &slot = _slots[sequence % TRACE_RING_SIZE];
+		if (slot.Sequence.load(std::memory_order_acquire) != sequence)
+		{
+			continue;
+		}
+		TraceRecord record = slot.Record;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.Sequence.load(std::memory_order_relaxed) == sequence)
+		{
+			out.append((const char *)&record, sizeof(record));
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#include "Log.h"
+#include "WebApi.h"
+
+#define PACKS_URI "/api/packs/"
+
+namespace PylonToMQTT
+{
+
+	void WebApi::begin(AsyncWebServer *pwebServer)
+	{
+		if (_started)
+		{
+			return;
+		}
+		_started = true;
+		_etagBase = esp_random();
+		pwebServer->on("/api/readings", HTTP_GET, [this](AsyncWebServerRequest *request)
+					   { send(request, _readings); });
+		pwebServer->on(PACKS_URI "*", HTTP_GET, [this](AsyncWebServerRequest *request)
+					   {
+			int pack = request->url().substring(strlen(PACKS_URI)).toInt();
+			if (pack < 1 || pack > _packCount)
+			{
+				request->send(404, "application/json", "{\"error\":\"unknown pack\"}");
+				return;
+			}
+			send(request, _packs[pack - 1]); });
+	}
+
+	// called after each pack is published, only the changed packs get a new version
+	void WebApi::UpdatePack(int packIndex, const String &json)
+	{
+		if (packIndex >= MAX_PACKS)
+		{
+			return;
+		}
+		if (_packs[packIndex].Get()->compare(json.c_str()) == 0)
+		{
+			return;
+		}
+		_packs[packIndex].Edit().assign(json.c_str(), json.length());
+		_packs[packIndex].Commit();
+		_dirty = true;
+	}
+
+	// called once per sequence to rebuild the bank document from the pack snapshots
+	void WebApi::Commit(int packCount)
+	{
+		_packCount = min(packCount, MAX_PACKS);
+		if (!_dirty)
+		{
+			return;
+		}
+		_dirty = false;
+		std::string &body = _readings.Edit();
+		char key[16];
+		body += '{';
+		for (int i = 0; i < _packCount; i++)
+		{
+			std::shared_ptr<const std::string> pack = _packs[i].Get();
+			if (pack->empty())
+			{
+				continue;
+			}
+			if (body.size() > 1)
+			{
+				body += ',';
+			}
+			sprintf(key, "\"Pack%d\":", i + 1);
+			body += key;
+			body += *pack;
+		}
+		body += '}';
+		_readings.Commit();
+	}
+
+	void WebApi::send(AsyncWebServerRequest *request, SharedBuffer &buffer)
+	{
+		uint32_t version;
+		std::shared_ptr<const std::string> body = buffer.Get(&version);
+		if (body->empty())
+		{
+			request->send(503, "application/json", "{\"error\":\"no readings yet\"}");
+			return;
+		}
+		char etag[24];
+		sprintf(etag, "\"%08x-%x\"", _etagBase, version);
+		if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag)
+		{
+			AsyncWebServerResponse *response = request->beginResponse(304);
+			response->addHeader("ETag", etag);
+			request->send(response);
+			return;
+		}
+		// the response holds on to the snapshot until the last chunk is sent
+		AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+																		 {
+			size_t len = min(maxLen, body->size() - index);
+			memcpy(buffer, body->data() + index, len);
+			return len; });
+		response->addHeader("ETag", etag);
+		response->addHeader("Cache-Control", "no-cache");
+		request->send(response);
+	}
+
+} // namespace PylonToMQTT
@@ -0,0 +1,133 @@
+#include "Log.h"
+#include "WebDashboard.h"
+
+namespace PylonToMQTT
+{
+	WebSocketsServer _homeSocket = WebSocketsServer(WSOCKET_HOME_PORT);
+
+	void WebDashboard::begin()
+	{
+		if (_started)
+		{
+			return;
+		}
+		_started = true;
+		_homeSocket.begin();
+		_homeSocket.onEvent([this](uint8_t num, WStype_t type, uint8_t *payload, size_t length)
+							{ 
+			if (type == WStype_DISCONNECTED)
+			{
+				logi("[%u] Home Page Disconnected!\n", num);
+			}
+			else if (type == WStype_CONNECTED)
+			{
+				logi("[%u] Home Page Connected!\n", num);
+				size_t len = encodeKeyframe(); // deltas that follow are relative to the last broadcast
+				_homeSocket.sendBIN(num, _buffer, len);
+			} });
+	}
+
+	void WebDashboard::process()
+	{
+		_homeSocket.loop();
+	}
+
+	void WebDashboard::Update(const BankReadings &readings)
+	{
+		uint8_t packCount = readings.PackCount;
+		for (int i = 0; i < packCount; i++)
+		{
+			encodePack(&_frame[i * DASHBOARD_PACK_WORDS], readings, i);
+		}
+		size_t wordCount = packCount * DASHBOARD_PACK_WORDS;
+		bool keyframe = packCount != _packCount;
+		_packCount = packCount;
+		if (!keyframe && memcmp(_frame, _sent, wordCount * sizeof(uint16_t)) == 0)
+		{
+			return; // nothing changed
+		}
+		_sequence++;
+		if (_homeSocket.connectedClients() > 0)
+		{
+			// one encoding for all clients, they all hold the previous broadcast
+			size_t len = keyframe ? 0 : encodeDelta(wordCount);
+			memcpy(_sent, _frame, wordCount * sizeof(uint16_t));
+			if (len == 0)
+			{
+				len = encodeKeyframe();
+			}
+			_homeSocket.broadcastBIN(_buffer, len);
+		}
+		else
+		{
+			memcpy(_sent, _frame, wordCount * sizeof(uint16_t));
+		}
+	}
+
+	void WebDashboard::encodePack(uint16_t *words, const BankReadings &readings, uint8_t pack)
+	{
+		words[0] = readings.VoltageMillivolts[pack];
+		words[1] = (uint16_t)readings.CurrentCentiamps[pack];
+		words[2] = readings.SOC(pack);
+		words[3] = readings.RemainingCentiamphours[pack];
+		words[4] = readings.FullCentiamphours[pack];
+		words[5] = readings.CycleCount[pack];
+		words[6] = readings.NumberOfCells[pack] | (readings.NumberOfTemps[pack] << 8);
+		words[7] = readings.CurrentState[pack] | (readings.VoltageState[pack] << 8);
+		const uint8_t *status = readings.Status[pack];
+		words[8] = status[ProtectStatus1] | (status[ProtectStatus2] << 8);
+		words[9] = status[SystemStatus] | (status[FaultStatus] << 8);
+		words[10] = status[AlarmStatus1] | (status[AlarmStatus2] << 8);
+		memcpy(&words[11], readings.CellMillivolts[pack], sizeof(readings.CellMillivolts[pack]));
+		memcpy(&words[27], readings.TempDeciKelvin[pack], sizeof(readings.TempDeciKelvin[pack]));
+		const uint8_t *cellStates = readings.CellStates[pack];
+		for (int i = 0; i < MAX_CELLS / 2; i++)
+		{
+			words[33 + i] = cellStates[i * 2] | (cellStates[i * 2 + 1] << 8);
+		}
+		const uint8_t *tempStates = readings.TempStates[pack];
+		for (int i = 0; i < MAX_TEMPS / 2; i++)
+		{
+			words[41 + i] = tempStates[i * 2] | (tempStates[i * 2 + 1] << 8);
+		}
+	}
+
+	size_t WebDashboard::encodeKeyframe()
+	{
+		_buffer[0] = 'K';
+		_buffer[1] = _packCount;
+		_buffer[2] = _sequence & 0xFF;
+		_buffer[3] = _sequence >> 8;
+		size_t len = DASHBOARD_HEADER_SIZE;
+		for (int i = 0; i < _packCount * DASHBOARD_PACK_WORDS; i++)
+		{
+			_buffer[len++] = _sent[i] & 0xFF;
+			_buffer[len++] = _sent[i] >> 8;
+		}
+		return len;
+	}
+
+	// returns 0 when a keyframe would be smaller
+	size_t WebDashboard::encodeDelta(size_t wordCount)
+	{
+		size_t bitmapSize = (wordCount + 7) / 8;
+		_buffer[0] = 'D';
+		_buffer[1] = _packCount;
+		_buffer[2] = _sequence & 0xFF;
+		_buffer[3] = _sequence >> 8;
+		uint8_t *bitmap = &_buffer[DASHBOARD_HEADER_SIZE];
+		memset(bitmap, 0, bitmapSize);
+		size_t len = DASHBOARD_HEADER_SIZE + bitmapSize;
+		for (int i = 0; i < wordCount; i++)
+		{
+			if (_frame[i] != _sent[i])
+			{
+				bitmap[i >> 3] |= 1 << (i & 7);
+				_buffer[len++] = _frame[i] & 0xFF;
+				_buffer[len++] = _frame[i] >> 8;
+			}
+		}
+		return len < DASHBOARD_HEADER_SIZE + wordCount * 2 ? len : 0;
+	}
+
+} // namespace PylonToMQTT
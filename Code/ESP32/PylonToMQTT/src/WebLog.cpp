@@ -1,30 +1,35 @@
 #include "Log.h"
 #include "WebLog.h"
+#include <memory>
+#include <atomic>
+#include "Trace.h"
+
+#define LOG_DROP_NOTICE_SIZE 48 // kept free at the end of a batch for the dropped lines notice
 
 WebSocketsServer _webSocket = WebSocketsServer(WSOCKET_LOG_PORT);
+RingbufHandle_t _logRing = NULL;
+std::atomic<uint32_t> _logDropped{0}; // incremented by every logging task
+uint8_t weblog_level = APP_LOG_LEVEL;
 
+// formats once into a stack buffer and queues the line for the log task, never blocks the caller
 int weblog_log_printfv(const char *format, va_list arg)
 {
-    static char loc_buf[256];
-    char * temp = loc_buf;
-    uint32_t len;
-    va_list copy;
-    va_copy(copy, arg);
-    len = vsnprintf(NULL, 0, format, copy);
-    va_end(copy);
-    if(len >= sizeof(loc_buf)){
-        temp = (char*)malloc(len+1);
-        if(temp == NULL) {
-            return 0;
-        }
+    char buf[LOG_LINE_SIZE];
+    int len = vsnprintf(buf, sizeof(buf), format, arg);
+    if (len <= 0) {
+        return 0;
+    }
+    if (len >= sizeof(buf)) {
+        len = sizeof(buf) - 1; // truncated
+    }
+    if (_logRing == NULL) { // log task not started yet
+        return ets_printf("%s", buf);
     }
-    vsnprintf(temp, len+1, format, arg);
-    _webSocket.broadcastTXT(temp);
-    if(len >= sizeof(loc_buf)){
-        free(temp);
+    if (xRingbufferSend(_logRing, buf, len, 0) != pdTRUE) {
+        _logDropped++;
+        return 0;
     }
-    int rVal = ets_printf("%s", temp);
-    return rVal;
+    return len;
 }
 
 int weblog(const char *format, ...)
@@ -37,8 +42,67 @@ int weblog(const char *format, ...)
     return len;
 }
 
+bool weblog_set_level(const char *level)
+{
+    const char *names[] = {"none", "error", "warn", "info", "debug", "verbose"};
+    int value = -1;
+    if (isdigit(level[0])) {
+        value = atoi(level);
+    }
+    for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcasecmp(level, names[i]) == 0) {
+            value = i;
+        }
+    }
+    if (value < ARDUHAL_LOG_LEVEL_NONE || value > ARDUHAL_LOG_LEVEL_VERBOSE) {
+        return false;
+    }
+    weblog_level = min(value, APP_LOG_LEVEL); // levels above APP_LOG_LEVEL are compiled out
+    ets_printf("Log level set to %d\n", weblog_level);
+    return true;
+}
+
+// low priority task, owns the log socket and drains the ring buffer in batches
+void WebLog::task(void *arg)
+{
+    static char batch[LOG_BATCH_SIZE + 1];
+    for (;;) {
+        _webSocket.loop();
+        vTaskDelay(pdMS_TO_TICKS(LOG_FLUSH_INTERVAL));
+        size_t len = 0;
+        while (len < LOG_BATCH_SIZE - LOG_DROP_NOTICE_SIZE) {
+            size_t size;
+            char *item = (char *)xRingbufferReceiveUpTo(_logRing, &size, 0, LOG_BATCH_SIZE - LOG_DROP_NOTICE_SIZE - len);
+            if (item == NULL) {
+                break;
+            }
+            memcpy(&batch[len], item, size);
+            len += size;
+            vRingbufferReturnItem(_logRing, item);
+        }
+        if (_webSocket.connectedClients() > 0) {
+            len += _trace.Format(&batch[len], LOG_BATCH_SIZE - LOG_DROP_NOTICE_SIZE - len); // trace records are only formatted while someone is watching
+        }
+        uint32_t dropped = _logDropped.exchange(0);
+        if (dropped > 0) {
+            int notice = snprintf(&batch[len], sizeof(batch) - len, "*** %u log lines dropped\n", dropped);
+            len += min<size_t>(max(notice, 0), sizeof(batch) - 1 - len); // snprintf returns the untruncated length
+        }
+        if (len > 0) {
+            batch[len] = 0;
+            ets_printf("%s", batch);
+            if (_webSocket.connectedClients() > 0) {
+                _webSocket.broadcastTXT(batch, len);
+            }
+        }
+    }
+}
+
 void WebLog::begin(AsyncWebServer *pwebServer)
 {
+    if (_task != NULL) {
+        return;
+    }
     _webSocket.begin();
     _webSocket.onEvent([](uint8_t num, WStype_t type, uint8_t *payload, size_t length)
                        { 
@@ -52,9 +116,18 @@ void WebLog::begin(AsyncWebServer *pwebServer)
 		} });
     pwebServer->on("/log", HTTP_GET, [](AsyncWebServerRequest *request)
                    { request->send(200, "text/html", web_serial_html); });
-}
-
-void WebLog::process()
-{
-    _webSocket.loop();
+    pwebServer->on("/trace", HTTP_GET, [](AsyncWebServerRequest *request)
+                   {
+        std::shared_ptr<std::string> body = std::make_shared<std::string>();
+        _trace.Snapshot(*body);
+        request->send(request->beginChunkedResponse("application/octet-stream", [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            size_t len = min(maxLen, body->size() - index);
+            memcpy(buffer, body->data() + index, len);
+            return len; })); });
+    _logRing = xRingbufferCreate(LOG_RING_SIZE, RINGBUF_TYPE_BYTEBUF);
+    if (_logRing == NULL) {
+        ets_printf("Failed to create log ring buffer\n");
+        return;
+    }
+    xTaskCreatePinnedToCore(task, "weblog", 4096, this, tskIDLE_PRIORITY + 1, &_task, NETWORK_CORE);
 }
@@ -9,29 +9,31 @@
 using namespace PylonToMQTT;
 
 IOT _iot = IOT();	
-unsigned long _lastPublishTimeStamp = 0;
-Pylon _Pylon = Pylon();
+Pylon _Pylon;
+Pylon *_Pylon2 = NULL; // optional second bank
 
 void setup()
 {
 	Serial.begin(115200);
 	while (!Serial) {}	
-	_lastPublishTimeStamp = millis() + COMMAND_PUBLISH_RATE;
-	// Set up object used to communicate with battery, provide callback to MQTT publish
-	_Pylon.begin(&_iot);
 	_iot.Init(&_Pylon);
+	// Set up the objects used to communicate with each battery bank, each polls from its own task and publishes through its bank's MQTT topics
+	_Pylon.begin(_iot.Bank(0), 0, &Serial2, RXPIN, TXPIN);
+	if (_iot.BankCount() > 1)
+	{
+		_Pylon2 = new Pylon();
+		_Pylon2->begin(_iot.Bank(1), 1, &Serial1, RX2PIN, TX2PIN);
+		_iot.SetBankCallback(1, _Pylon2); // cmnd/# of the second bank goes to its own Pylon
+	}
 	logd("Setup Done");
 }
 
 void loop()
 {
 	_Pylon.Process();
-	if (_iot.Run()) {
-		_Pylon.Receive(SERIAL_RECEIVE_TIMEOUT); 
-		if (_lastPublishTimeStamp < millis())
-		{
-			unsigned long currentPublishRate = _Pylon.Transmit() == true ? _iot.PublishRate() : COMMAND_PUBLISH_RATE;
-			_lastPublishTimeStamp = millis() + currentPublishRate;
-		}
+	_iot.Run();
+	if (_iot.LowPower())
+	{
+		delay(LOW_POWER_LOOP_DELAY); // let the idle task halt the CPU between passes
 	}
 }
@@ -0,0 +1,67 @@
+#pragma once
+// Host stand-in for the parts of the Arduino core the native tests link (AsyncSerial, ModbusRequest, BusEngine, Trace), see [env:native]
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+using std::max;
+using std::min;
+
+class String; // only named in declarations the host builds do not call
+
+unsigned long micros(); // test/host/FakeClock.h, on the virtual clock
+
+// cycle counter of the latency histograms, the tests do not look at durations
+class EspClass
+{
+public:
+	uint32_t getCycleCount() { return 0; };
+	uint32_t getCpuFreqMHz() { return 240; };
+};
+static EspClass ESP;
+
+#if !defined(__GLIBC__) || __GLIBC__ == 2 && __GLIBC_MINOR__ < 38
+inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+	if (size > 0)
+	{
+		size_t n = len < size - 1 ? len : size - 1;
+		memcpy(dst, src, n);
+		dst[n] = 0;
+	}
+	return len;
+}
+#endif
+
+// the tests run on one thread, critical sections have nothing to exclude
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) (void)(mux)
+#define portEXIT_CRITICAL(mux) (void)(mux)
+
+class Stream
+{
+public:
+	virtual ~Stream() {};
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+	virtual size_t write(uint8_t data) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size)
+	{
+		size_t n = 0;
+		while (size--)
+		{
+			n += write(*buffer++);
+		}
+		return n;
+	};
+};
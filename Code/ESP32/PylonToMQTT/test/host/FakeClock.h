@@ -0,0 +1,30 @@
+#pragma once
+#include "Clock.h"
+
+namespace PylonToMQTT
+{
+
+// Virtual time for the native tests, Delay and Wait return at once with the clock moved on.
+// Included once by each test's main, it also defines the _clock the sources from src use.
+class FakeClock : public Clock
+{
+public:
+	uint32_t Millis() { return Now; };
+	void Delay(uint32_t ms) { Now += ms; };
+	void Wait(uint32_t ms)
+	{
+		Now += ms;
+		Waits++;
+	};
+	uint64_t EpochMillis() { return 0; };
+
+	uint32_t Now = 0;
+	uint32_t Waits = 0;
+};
+
+FakeClock _fakeClock;
+Clock *_clock = &_fakeClock;
+
+} // namespace PylonToMQTT
+
+unsigned long micros() { return PylonToMQTT::_fakeClock.Now * 1000UL; } // trace timestamps
@@ -0,0 +1,3 @@
+#pragma once
+// Host stand-in, Enumerations.h includes the Arduino String header but the host builds do not use String
+#include "Arduino.h"
@@ -0,0 +1,337 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "FakeClock.h"
+#include "BusEngine.h"
+
+using namespace PylonToMQTT;
+
+#define PEER_LATENCY 120 // ms from the command to the response on the wire
+
+// captured responses of a US2000C (Docs/*.txt), readdressed to the polled pack by the peer
+const char _analogValueFrame[] = "~25014600D07C0001100D200D240D240D210D210D220D230D240D220D210D220D220D230D220D230D21060B230B210B270B260B450B4E0050D22327CF0227D6000B271063E372";
+const char _alarmInfoFrame[] = "~25014600E04E00011002020202010101000000000000000001060201010101020002020080A600000000000000EEA1";
+const char _versionInfoFrame[] = "~25014600602850313653313030412D31423437302D312E303400F586";
+const char _barCodeFrame[] = "~25014600B05031423437303130323137303939394420202020204D617220333020323032322C31383A31383A3136ED77";
+
+// SOI, checksum over the ASCII body, no EOI
+static std::string seal(const std::string &body)
+{
+	uint16_t sum = 0;
+	for (size_t i = 0; i < body.size(); i++)
+	{
+		sum += body[i];
+	}
+	char checksum[5];
+	snprintf(checksum, sizeof(checksum), "%04X", (uint16_t)(~sum + 1));
+	return "~" + body + checksum;
+}
+
+// a captured frame with ADR and, for the INFO of AnalogValueFixedPoint and AlarmInfo, the pack number set to address
+static std::string readdress(const char *frame, uint8_t address, bool infoPack)
+{
+	std::string body(frame + 1, strlen(frame) - 5);
+	char hex[3];
+	snprintf(hex, sizeof(hex), "%02X", address);
+	body.replace(2, 2, hex);
+	if (infoPack)
+	{
+		body.replace(14, 2, hex);
+	}
+	return seal(body);
+}
+
+static uint8_t field(const std::string &command, size_t offset)
+{
+	return strtoul(command.substr(offset, 2).c_str(), NULL, 16);
+}
+
+static uint8_t address(const std::string &command) { return field(command, 3); };
+static uint8_t cid2(const std::string &command) { return field(command, 7); };
+
+// battery console on the other end of the UART, answers the real commands of the bus engine for a bank of packs
+class ScriptedPeer : public Stream
+{
+public:
+	ScriptedPeer(uint8_t packs) : _packs(packs) {};
+	void Silence(int commands) { _silent = commands; }; // the next commands go unanswered
+
+	int available() { return Clock::Elapsed(_fakeClock.Millis() + 1, _readyAt) ? _rx.size() - _rxIndex : 0; };
+	int read() { return available() ? (uint8_t)_rx[_rxIndex++] : -1; };
+	int peek() { return available() ? (uint8_t)_rx[_rxIndex] : -1; };
+	size_t write(uint8_t data)
+	{
+		if (data != '\r')
+		{
+			_command += (char)data;
+			return 1;
+		}
+		Commands.push_back(_command);
+		CommandMillis.push_back(_fakeClock.Millis());
+		std::string frame = _silent > 0 ? "" : answer(_command);
+		_silent = _silent > 0 ? _silent - 1 : 0;
+		_command.clear();
+		_rx = frame.empty() ? "" : frame + "\r";
+		_rxIndex = 0;
+		_readyAt = _fakeClock.Millis() + PEER_LATENCY;
+		return 1;
+	};
+
+	std::vector<std::string> Commands;
+	std::vector<uint32_t> CommandMillis; // virtual time each command was written
+
+private:
+	std::string answer(const std::string &command)
+	{
+		uint8_t adr = address(command);
+		switch (cid2(command))
+		{
+		case CommandInformation::GetPackCount:
+		{
+			char body[16];
+			snprintf(body, sizeof(body), "25%02X4600E002%02X", adr, _packs);
+			return seal(body);
+		}
+		case CommandInformation::GetVersionInfo:
+			return readdress(_versionInfoFrame, adr, false);
+		case CommandInformation::GetBarCode:
+			return readdress(_barCodeFrame, adr, false);
+		case CommandInformation::AnalogValueFixedPoint:
+			return readdress(_analogValueFrame, adr, true);
+		case CommandInformation::AlarmInfo:
+			return readdress(_alarmInfoFrame, adr, true);
+		}
+		return "";
+	}
+
+	uint8_t _packs;
+	int _silent = 0;
+	std::string _command;
+	std::string _rx;
+	size_t _rxIndex = 0;
+	uint32_t _readyAt = 0;
+};
+
+// the bus engine on the peer, Run() makes the same Step() calls as Pylon::task and stands in for the publish task
+class Bus : public BusEngine
+{
+public:
+	Bus(ScriptedPeer &peer, uint32_t publishRate, bool lowPower) : _publishRate(publishRate), _lowPower(lowPower)
+	{
+		Start(&peer);
+	}
+
+	void Run(uint32_t ms)
+	{
+		uint32_t start = _fakeClock.Millis();
+		while (_fakeClock.Millis() - start < ms)
+		{
+			Step(true, _publishRate, _lowPower);
+		}
+	}
+
+	void timeout()
+	{
+		BusEngine::timeout();
+		TimeoutMillis = _fakeClock.Millis();
+	}
+
+	const BankCounters &Counters() { return _counters; };
+	const DutyCycle &Duty() { return _dutyCycle; };
+
+	std::vector<PackSnapshot> Snapshots; // as taken by the publisher
+	std::vector<uint32_t> SnapshotMillis;
+	std::vector<uint32_t> SequenceMillis; // SequenceComplete markers, each triggers the bank's publish
+	uint32_t TimeoutMillis = 0;
+
+protected:
+	void notifyPublisher()
+	{
+		PackSnapshot snapshot;
+		while (_snapshots.Pop(snapshot))
+		{
+			Snapshots.push_back(snapshot);
+			SnapshotMillis.push_back(_fakeClock.Millis());
+			if (snapshot.SequenceComplete)
+			{
+				SequenceMillis.push_back(_fakeClock.Millis());
+			}
+		}
+	}
+
+private:
+	uint32_t _publishRate;
+	bool _lowPower;
+};
+
+// readings sequences of a bank of packs: AnalogValueFixedPoint, AlarmInfo and the slot that hands the pack to the publisher,
+// COMMAND_PUBLISH_RATE apart, a completed sequence waits publishRate
+static void assertReadingsTiming(ScriptedPeer &peer, Bus &bus, uint8_t packs, uint32_t publishRate)
+{
+	size_t first = 1 + 2 * packs; // GetPackCount, then GetVersionInfo and GetBarCode per pack
+	TEST_ASSERT_GREATER_THAN(first + 4 * packs, peer.Commands.size());
+	for (size_t i = first; i < peer.Commands.size(); i++)
+	{
+		size_t slot = (i - first) % (2 * packs);
+		TEST_ASSERT_EQUAL_HEX8(slot % 2 == 0 ? CommandInformation::AnalogValueFixedPoint : CommandInformation::AlarmInfo, cid2(peer.Commands[i]));
+		TEST_ASSERT_EQUAL(slot / 2 + 1, address(peer.Commands[i]));
+		uint32_t gap = peer.CommandMillis[i] - peer.CommandMillis[i - 1];
+		uint32_t expected = slot == 0 ? publishRate + COMMAND_PUBLISH_RATE : slot % 2 == 0 ? 2 * COMMAND_PUBLISH_RATE : COMMAND_PUBLISH_RATE;
+		TEST_ASSERT_GREATER_OR_EQUAL_UINT32(expected, gap);
+		TEST_ASSERT_UINT32_WITHIN(1, expected, gap);
+	}
+	TEST_ASSERT_GREATER_THAN(2, bus.SequenceMillis.size());
+	for (size_t i = 2; i < bus.SequenceMillis.size(); i++) // the first sequence queries the pack info
+	{
+		TEST_ASSERT_UINT32_WITHIN(1, publishRate + (3 * packs - 1) * COMMAND_PUBLISH_RATE, bus.SequenceMillis[i] - bus.SequenceMillis[i - 1]);
+	}
+}
+
+void setUp()
+{
+	_fakeClock.Now = 1000;
+	_fakeClock.Waits = 0;
+}
+void tearDown() {}
+
+void test_discovers_bank_then_polls()
+{
+	ScriptedPeer peer(2);
+	Bus bus(peer, 5000, false);
+	bus.Run(20000);
+	TEST_ASSERT_EQUAL_HEX8(CommandInformation::GetPackCount, cid2(peer.Commands[0]));
+	TEST_ASSERT_EQUAL_HEX8(0xFF, address(peer.Commands[0]));
+	TEST_ASSERT_EQUAL_HEX8(CommandInformation::GetVersionInfo, cid2(peer.Commands[1]));
+	TEST_ASSERT_EQUAL_HEX8(CommandInformation::GetBarCode, cid2(peer.Commands[2]));
+	TEST_ASSERT_EQUAL(2, address(peer.Commands[4]));
+	TEST_ASSERT_EQUAL(0, bus.Counters().Timeouts);
+	TEST_ASSERT_EQUAL(0, bus.Counters().ChecksumFailures);
+
+	int info = 0;
+	int discovery = 0;
+	int readings[2] = {};
+	for (size_t i = 0; i < bus.Snapshots.size(); i++)
+	{
+		const PackSnapshot &snapshot = bus.Snapshots[i];
+		TEST_ASSERT_EQUAL(2, snapshot.PackCount);
+		info += snapshot.Topology == InfoMessage;
+		discovery += snapshot.Topology == DiscoveryMessage;
+		if (snapshot.Topology == NoTopology && snapshot.Sections != 0)
+		{
+			TEST_ASSERT_EQUAL_HEX8(AnalogSection | AlarmSection, snapshot.Sections);
+			readings[snapshot.Pack]++;
+		}
+	}
+	TEST_ASSERT_EQUAL(2, info);
+	TEST_ASSERT_EQUAL(2, discovery); // once the cell and temperature counts are known
+	TEST_ASSERT_EQUAL(bus.SequenceMillis.size() - 1, readings[0]);
+	TEST_ASSERT_TRUE(readings[1] == readings[0] || readings[1] == readings[0] - 1);
+}
+
+void test_readings_decode_per_pack()
+{
+	ScriptedPeer peer(2);
+	Bus bus(peer, 5000, false);
+	bus.Run(20000);
+	BankReadings readings;
+	TEST_ASSERT_NOT_EQUAL(0, bus.ReadBank(readings));
+	TEST_ASSERT_EQUAL(2, readings.PackCount);
+	for (int p = 0; p < 2; p++)
+	{
+		TEST_ASSERT_EQUAL(16, readings.NumberOfCells[p]);
+		TEST_ASSERT_EQUAL(3360, readings.CellMillivolts[p][0]);
+		TEST_ASSERT_EQUAL(6, readings.NumberOfTemps[p]);
+		TEST_ASSERT_EQUAL(2851, readings.TempDeciKelvin[p][0]);
+		TEST_ASSERT_EQUAL(80, readings.CurrentCentiamps[p]);
+		TEST_ASSERT_EQUAL(53795, readings.VoltageMillivolts[p]);
+		TEST_ASSERT_EQUAL(11, readings.CycleCount[p]);
+		TEST_ASSERT_LESS_THAN_UINT32(5000 + 6 * COMMAND_PUBLISH_RATE, _fakeClock.Millis() - readings.SampleMillis[p]); // EOI of this or the last sequence's frame
+	}
+}
+
+void test_command_and_publish_timing()
+{
+	ScriptedPeer peer(2);
+	Bus bus(peer, 5000, false);
+	bus.Run(40000);
+	assertReadingsTiming(peer, bus, 2, 5000);
+	// each pack goes to the publisher on the slot after its AlarmInfo, the marker with the last pack's
+	for (size_t i = 0; i < bus.Snapshots.size(); i++)
+	{
+		if (bus.Snapshots[i].Topology == NoTopology && bus.Snapshots[i].Sections != 0)
+		{
+			uint32_t sent = bus.SnapshotMillis[i];
+			bool afterAlarm = false;
+			for (size_t c = 0; c < peer.Commands.size(); c++)
+			{
+				afterAlarm |= cid2(peer.Commands[c]) == CommandInformation::AlarmInfo && address(peer.Commands[c]) == bus.Snapshots[i].Pack + 1 && sent - peer.CommandMillis[c] == COMMAND_PUBLISH_RATE;
+			}
+			TEST_ASSERT_TRUE(afterAlarm);
+		}
+	}
+}
+
+void test_silent_peer_times_out()
+{
+	ScriptedPeer peer(1);
+	peer.Silence(1);
+	Bus bus(peer, 5000, false);
+	bus.Run(8000);
+	TEST_ASSERT_EQUAL(1, bus.Counters().Timeouts);
+	TEST_ASSERT_GREATER_THAN_UINT32(SERIAL_RECEIVE_TIMEOUT, bus.TimeoutMillis - peer.CommandMillis[0]);
+	TEST_ASSERT_UINT32_WITHIN(2, SERIAL_RECEIVE_TIMEOUT, bus.TimeoutMillis - peer.CommandMillis[0]);
+	TEST_ASSERT_EQUAL_HEX8(CommandInformation::GetPackCount, cid2(peer.Commands[1])); // still no packs, asked again
+	TEST_ASSERT_UINT32_WITHIN(1, bus.TimeoutMillis, peer.CommandMillis[1]); // overdue, sent as soon as the bus is free
+	TEST_ASSERT_UINT32_WITHIN(1, COMMAND_PUBLISH_RATE, peer.CommandMillis[2] - peer.CommandMillis[1]);
+}
+
+void test_schedule_across_millis_wrap()
+{
+	_fakeClock.Now = 0xFFFFFFFF - 5 * COMMAND_PUBLISH_RATE;
+	ScriptedPeer peer(1);
+	Bus bus(peer, 5000, false);
+	bus.Run(30000);
+	assertReadingsTiming(peer, bus, 1, 5000);
+	TEST_ASSERT_LESS_THAN_UINT32(0x10000, peer.CommandMillis.back()); // ran on past the wrap
+	TEST_ASSERT_EQUAL(0, bus.Counters().Timeouts);
+}
+
+void test_low_power_sleeps_until_due()
+{
+	ScriptedPeer peer(1);
+	Bus bus(peer, 10000, true);
+	bus.Run(50000);
+	assertReadingsTiming(peer, bus, 1, 10000);
+	TEST_ASSERT_LESS_THAN_UINT32(3 * peer.Commands.size() + 2, _fakeClock.Waits); // a few waits per command instead of one per ms
+	TEST_ASSERT_TRUE(bus.Duty().DutyPercent() < 5); // awake only for the answers
+	TEST_ASSERT_TRUE(bus.Counters().AverageMilliamps < SLEEP_CURRENT_MA + 5);
+	TEST_ASSERT_TRUE(bus.Counters().DutyPercent > 0);
+}
+
+void test_idle_time_wakes_for_burst()
+{
+	BusSchedule schedule;
+	schedule.Start(0);
+	schedule.Sent(1000, true, 10000);
+	schedule.Burst(1000);
+	TEST_ASSERT_EQUAL_UINT32(10000, schedule.IdleTime(1000, false));
+	TEST_ASSERT_EQUAL_UINT32(ALARM_BURST_RATE, schedule.IdleTime(1000, true));
+	TEST_ASSERT_FALSE(schedule.BurstDue(1000 + ALARM_BURST_RATE - 1));
+	TEST_ASSERT_TRUE(schedule.BurstDue(1000 + ALARM_BURST_RATE));
+	schedule.Sent(1000, true, 60000);
+	TEST_ASSERT_EQUAL_UINT32(MAX_PUBLISH_RATE, schedule.IdleTime(1000, false)); // wakes at least every MAX_PUBLISH_RATE
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_discovers_bank_then_polls);
+	RUN_TEST(test_readings_decode_per_pack);
+	RUN_TEST(test_command_and_publish_timing);
+	RUN_TEST(test_silent_peer_times_out);
+	RUN_TEST(test_schedule_across_millis_wrap);
+	RUN_TEST(test_low_power_sleeps_until_due);
+	RUN_TEST(test_idle_time_wakes_for_burst);
+	return UNITY_END();
+}
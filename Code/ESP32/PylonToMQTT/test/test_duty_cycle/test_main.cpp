@@ -0,0 +1,94 @@
+#include <unity.h>
+#include "FakeClock.h" // _clock for the sources linked from src
+#include "DutyCycle.h"
+
+using namespace PylonToMQTT;
+
+#define ACTIVE_MA 100.0
+#define SLEEP_MA 10.0
+
+void setUp() {}
+void tearDown() {}
+
+void test_sleep_time_until_due()
+{
+	TEST_ASSERT_EQUAL_UINT32(250, DutyCycle::SleepTime(1000, 1250, 5000));
+}
+
+void test_sleep_time_clamped_to_limit()
+{
+	TEST_ASSERT_EQUAL_UINT32(5000, DutyCycle::SleepTime(1000, 60000, 5000));
+}
+
+void test_sleep_time_overdue()
+{
+	TEST_ASSERT_EQUAL_UINT32(1, DutyCycle::SleepTime(1000, 1000, 5000));
+	TEST_ASSERT_EQUAL_UINT32(1, DutyCycle::SleepTime(1250, 1000, 5000));
+}
+
+void test_sleep_time_across_millis_wrap()
+{
+	TEST_ASSERT_EQUAL_UINT32(32, DutyCycle::SleepTime(0xFFFFFFF0, 0x10, 5000));
+	TEST_ASSERT_EQUAL_UINT32(1, DutyCycle::SleepTime(0x10, 0xFFFFFFF0, 5000)); // due just before the wrap is overdue
+}
+
+// awake for 50 ms at the start and end of a 1000 ms cycle
+static void cycle(DutyCycle &dc, uint32_t start)
+{
+	dc.Asleep(start + 50);
+	dc.Awake(start + 950);
+	dc.CycleComplete(start + 1000);
+}
+
+void test_cycle_complete_duty()
+{
+	DutyCycle dc(ACTIVE_MA, SLEEP_MA);
+	dc.CycleComplete(1000); // first cycle starts asleep
+	TEST_ASSERT_FLOAT_WITHIN(0.01, 0.0, dc.DutyPercent());
+	cycle(dc, 1000);
+	TEST_ASSERT_FLOAT_WITHIN(0.01, 10.0, dc.DutyPercent());
+}
+
+void test_average_current_model()
+{
+	DutyCycle dc(ACTIVE_MA, SLEEP_MA);
+	dc.CycleComplete(1000);
+	TEST_ASSERT_FLOAT_WITHIN(0.01, SLEEP_MA, dc.AverageMilliamps());
+	cycle(dc, 1000);
+	TEST_ASSERT_FLOAT_WITHIN(0.01, ACTIVE_MA * 0.1 + SLEEP_MA * 0.9, dc.AverageMilliamps());
+	dc.CycleComplete(3000); // awake for the whole cycle
+	TEST_ASSERT_FLOAT_WITHIN(0.01, 100.0, dc.DutyPercent());
+	TEST_ASSERT_FLOAT_WITHIN(0.01, ACTIVE_MA, dc.AverageMilliamps());
+}
+
+void test_cycle_across_millis_wrap()
+{
+	DutyCycle dc(ACTIVE_MA, SLEEP_MA);
+	dc.CycleComplete(0xFFFFFE00);
+	cycle(dc, 0xFFFFFE00); // completes at 0x1E8
+	TEST_ASSERT_FLOAT_WITHIN(0.01, 10.0, dc.DutyPercent());
+	TEST_ASSERT_FLOAT_WITHIN(0.01, ACTIVE_MA * 0.1 + SLEEP_MA * 0.9, dc.AverageMilliamps());
+}
+
+void test_zero_length_cycle_keeps_last_model()
+{
+	DutyCycle dc(ACTIVE_MA, SLEEP_MA);
+	dc.CycleComplete(1000);
+	cycle(dc, 1000);
+	dc.CycleComplete(2000);
+	TEST_ASSERT_FLOAT_WITHIN(0.01, 10.0, dc.DutyPercent());
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_sleep_time_until_due);
+	RUN_TEST(test_sleep_time_clamped_to_limit);
+	RUN_TEST(test_sleep_time_overdue);
+	RUN_TEST(test_sleep_time_across_millis_wrap);
+	RUN_TEST(test_cycle_complete_duty);
+	RUN_TEST(test_average_current_model);
+	RUN_TEST(test_cycle_across_millis_wrap);
+	RUN_TEST(test_zero_length_cycle_keeps_last_model);
+	return UNITY_END();
+}
@@ -0,0 +1,113 @@
+#include <unity.h>
+#include "FakeClock.h" // _clock for the sources linked from src
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include "FrameDecode.h"
+
+using namespace PylonToMQTT;
+
+// captured responses (Docs/GetAnalogValue.txt, Docs/GetVersionInfo.txt)
+const char _analogValueFrame[] = "~25014600D07C0001100D200D240D240D210D210D220D230D240D220D210D220D220D230D220D230D21060B230B210B270B260B450B4E0050D22327CF0227D6000B271063E372";
+const char _versionInfoFrame[] = "~25014600602850313653313030412D31423437302D312E303400F586";
+
+// SOI, body and a valid CHKSUM, the body may hold any byte
+static std::string sealed(const std::string &body)
+{
+	uint16_t sum = 0;
+	for (size_t i = 0; i < body.size(); i++)
+	{
+		sum += (uint8_t)body[i];
+	}
+	char chksum[5];
+	snprintf(chksum, sizeof(chksum), "%04X", (uint16_t)(~sum + 1));
+	return "~" + body + chksum;
+}
+
+static FrameStatus decode(const std::string &frame, std::vector<uint8_t> &bytes, FrameHeader &header)
+{
+	return DecodeFrame(frame.data(), frame.size(), bytes, header);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_analog_frame()
+{
+	std::vector<uint8_t> bytes;
+	FrameHeader header;
+	TEST_ASSERT_EQUAL(FrameOk, decode(_analogValueFrame, bytes, header));
+	TEST_ASSERT_EQUAL_HEX8(0x25, header.Version);
+	TEST_ASSERT_EQUAL_HEX8(0x01, header.Address);
+	TEST_ASSERT_EQUAL_HEX8(0x00, header.Cid2);
+	TEST_ASSERT_EQUAL_HEX16(0x07C, header.LenId);
+	TEST_ASSERT_EQUAL(6 + 0x07C / 2, bytes.size());
+	FrameReader info(bytes.data() + 6, header.LenId / 2);
+	BankReadings readings = {};
+	uint16_t cells;
+	uint16_t temps;
+	TEST_ASSERT_TRUE(DecodeAnalog(info, readings, 0, MAX_TEMPS, cells, temps));
+	TEST_ASSERT_EQUAL(16, cells);
+	TEST_ASSERT_EQUAL(53795, readings.VoltageMillivolts[0]);
+}
+
+void test_version_frame()
+{
+	std::vector<uint8_t> bytes;
+	FrameHeader header;
+	TEST_ASSERT_EQUAL(FrameOk, decode(_versionInfoFrame, bytes, header));
+	TEST_ASSERT_EQUAL(0x028, header.LenId);
+	TEST_ASSERT_EQUAL_STRING_LEN("P16S100A-1B470-1.04", (const char *)bytes.data() + 6, 19);
+}
+
+void test_checksum_error()
+{
+	std::string frame = _analogValueFrame;
+	frame[20] = frame[20] == '0' ? '1' : '0';
+	std::vector<uint8_t> bytes;
+	FrameHeader header;
+	TEST_ASSERT_EQUAL(FrameChecksumError, decode(frame, bytes, header));
+}
+
+void test_too_short()
+{
+	std::vector<uint8_t> bytes;
+	FrameHeader header;
+	TEST_ASSERT_EQUAL(FrameTooShort, decode(sealed("2501460000"), bytes, header));
+}
+
+// LENID longer than the INFO received, with or without a NUL in the frame, must not be trusted
+void test_lenid_longer_than_frame()
+{
+	std::vector<uint8_t> bytes;
+	FrameHeader header;
+	TEST_ASSERT_EQUAL(FrameLengthError, decode(sealed("25014600D07C00011"), bytes, header));
+	std::string body("25014600D07C0001100D20", 22);
+	body[14] = '\0';
+	TEST_ASSERT_EQUAL(FrameLengthError, decode(sealed(body), bytes, header));
+	TEST_ASSERT_EQUAL_HEX16(0x07C, header.LenId);
+}
+
+// an embedded NUL is decoded as a zero nibble, the frame keeps its full length
+void test_embedded_nul()
+{
+	std::string body("2501460020020102", 16);
+	body[14] = '\0';
+	std::vector<uint8_t> bytes;
+	FrameHeader header;
+	TEST_ASSERT_EQUAL(FrameOk, decode(sealed(body), bytes, header));
+	TEST_ASSERT_EQUAL(8, bytes.size());
+	TEST_ASSERT_EQUAL_HEX8(0x02, bytes[7]);
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_analog_frame);
+	RUN_TEST(test_version_frame);
+	RUN_TEST(test_checksum_error);
+	RUN_TEST(test_too_short);
+	RUN_TEST(test_lenid_longer_than_frame);
+	RUN_TEST(test_embedded_nul);
+	return UNITY_END();
+}
@@ -0,0 +1,233 @@
+#include <unity.h>
+#include "FakeClock.h" // _clock for the sources linked from src
+#include <string>
+#include <vector>
+#include "ModbusServer.h"
+
+using namespace PylonToMQTT;
+
+static ModbusServer _server;
+static BankReadings _readings;
+
+// MBAP header (transaction 0x1234, protocol 0, length) and a read request
+static std::vector<uint8_t> request(uint8_t unit, uint8_t function, uint16_t address, uint16_t quantity)
+{
+	return {0x12, 0x34, 0x00, 0x00, 0x00, 0x06, unit, function, (uint8_t)(address >> 8), (uint8_t)address, (uint8_t)(quantity >> 8), (uint8_t)quantity};
+}
+
+static std::vector<uint8_t> handle(const std::vector<uint8_t> &frame)
+{
+	uint8_t response[MODBUS_MAX_FRAME];
+	size_t length = _server.HandleRequest(frame.data(), frame.size(), response);
+	return std::vector<uint8_t>(response, response + length);
+}
+
+static uint16_t registerAt(const std::vector<uint8_t> &response, int index)
+{
+	return (response[9 + index * 2] << 8) | response[10 + index * 2];
+}
+
+static void assertException(const std::vector<uint8_t> &response, uint8_t function, uint8_t code)
+{
+	TEST_ASSERT_EQUAL(MBAP_SIZE + 2, response.size());
+	TEST_ASSERT_EQUAL_HEX8(0x12, response[0]);
+	TEST_ASSERT_EQUAL_HEX8(0x34, response[1]);
+	TEST_ASSERT_EQUAL(3, response[5]);
+	TEST_ASSERT_EQUAL_HEX8(function | 0x80, response[7]);
+	TEST_ASSERT_EQUAL_HEX8(code, response[8]);
+}
+
+// collects the responses a connection writes back to its client
+struct Client
+{
+	ModbusConnection Connection;
+	std::vector<std::vector<uint8_t>> Responses;
+
+	bool Send(const uint8_t *data, size_t length)
+	{
+		return Connection.Receive(_server, data, length, [this](const uint8_t *response, size_t responseLength)
+								  { Responses.push_back(std::vector<uint8_t>(response, response + responseLength)); });
+	}
+	bool Send(const std::vector<uint8_t> &data) { return Send(data.data(), data.size()); }
+};
+
+void setUp()
+{
+	memset(&_readings, 0, sizeof(_readings));
+	_readings.PackCount = 2;
+	_readings.VoltageMillivolts[0] = 53795;
+	_readings.CurrentCentiamps[0] = -250;
+	_readings.RemainingCentiamphours[0] = 5000;
+	_readings.FullCentiamphours[0] = 10000;
+	_readings.CycleCount[0] = 11;
+	_readings.NumberOfCells[0] = 16;
+	_readings.Status[0][FaultStatus] = 0x10;
+	_readings.CellMillivolts[0][0] = 3360;
+	_readings.TempDeciKelvin[0][MAX_TEMPS - 1] = 2980;
+	_readings.VoltageMillivolts[1] = 52000;
+	_server.Update(_readings);
+}
+void tearDown() {}
+
+void test_read_holding_registers()
+{
+	std::vector<uint8_t> response = handle(request(1, 0x03, 0, 6));
+	TEST_ASSERT_EQUAL(MBAP_SIZE + 2 + 12, response.size());
+	TEST_ASSERT_EQUAL_HEX8(0x12, response[0]);
+	TEST_ASSERT_EQUAL_HEX8(0x34, response[1]);
+	TEST_ASSERT_EQUAL(3 + 12, (response[4] << 8) | response[5]);
+	TEST_ASSERT_EQUAL(1, response[6]);
+	TEST_ASSERT_EQUAL_HEX8(0x03, response[7]);
+	TEST_ASSERT_EQUAL(12, response[8]);
+	TEST_ASSERT_EQUAL(53795, registerAt(response, 0));
+	TEST_ASSERT_EQUAL_HEX16((uint16_t)-250, registerAt(response, 1));
+	TEST_ASSERT_EQUAL(50, registerAt(response, 2));
+	TEST_ASSERT_EQUAL(11, registerAt(response, 5));
+}
+
+void test_read_input_registers()
+{
+	std::vector<uint8_t> response = handle(request(1, 0x04, 13, 4));
+	TEST_ASSERT_EQUAL(MBAP_SIZE + 2 + 8, response.size());
+	TEST_ASSERT_EQUAL_HEX8(0x04, response[7]);
+	TEST_ASSERT_EQUAL(0x10, registerAt(response, 0)); // FaultSts
+	TEST_ASSERT_EQUAL(3360, registerAt(response, 3)); // Cell 1
+	response = handle(request(2, 0x04, 0, 1));
+	TEST_ASSERT_EQUAL(52000, registerAt(response, 0));
+}
+
+// unit 0 and 255 read the bank, pack n at (n - 1) * 100, the gap between packs reads as 0
+void test_read_bank()
+{
+	std::vector<uint8_t> response = handle(request(0, 0x03, MODBUS_PACK_REGISTERS - 1, 42));
+	TEST_ASSERT_EQUAL(MBAP_SIZE + 2 + 84, response.size());
+	TEST_ASSERT_EQUAL(0, registerAt(response, 0)); // last temperature state of pack 1
+	TEST_ASSERT_EQUAL(0, registerAt(response, 1));
+	TEST_ASSERT_EQUAL(52000, registerAt(response, MODBUS_BANK_STRIDE - MODBUS_PACK_REGISTERS + 1));
+	response = handle(request(0xFF, 0x04, MODBUS_BANK_STRIDE, 1));
+	TEST_ASSERT_EQUAL(52000, registerAt(response, 0));
+}
+
+void test_illegal_function()
+{
+	assertException(handle(request(1, 0x06, 0, 1)), 0x06, 0x01);
+	assertException(handle(request(1, 0x10, 0, 1)), 0x10, 0x01);
+}
+
+void test_illegal_quantity()
+{
+	assertException(handle(request(1, 0x03, 0, 0)), 0x03, 0x03);
+	assertException(handle(request(0, 0x03, 0, MODBUS_MAX_READ + 1)), 0x03, 0x03);
+	std::vector<uint8_t> shortRequest = request(1, 0x03, 0, 1);
+	shortRequest.resize(MBAP_SIZE + 3);
+	assertException(handle(shortRequest), 0x03, 0x03);
+}
+
+void test_out_of_range_address()
+{
+	assertException(handle(request(1, 0x03, MODBUS_PACK_REGISTERS - 1, 2)), 0x03, 0x02);
+	assertException(handle(request(1, 0x04, MODBUS_PACK_REGISTERS, 1)), 0x04, 0x02);
+	assertException(handle(request(0, 0x03, MODBUS_BANK_STRIDE + MODBUS_PACK_REGISTERS, 1)), 0x03, 0x02);
+	assertException(handle(request(1, 0x03, 0xFFFF, 1)), 0x03, 0x02);
+	TEST_ASSERT_EQUAL(MBAP_SIZE + 2 + 2, handle(request(1, 0x03, MODBUS_PACK_REGISTERS - 1, 1)).size());
+}
+
+void test_unknown_unit()
+{
+	assertException(handle(request(3, 0x03, 0, 1)), 0x03, 0x0B);
+	assertException(handle(request(MAX_PACKS + 1, 0x03, 0, 1)), 0x03, 0x0B);
+}
+
+void test_not_modbus()
+{
+	std::vector<uint8_t> frame = request(1, 0x03, 0, 1);
+	frame[3] = 1; // protocol id
+	TEST_ASSERT_EQUAL(0, handle(frame).size());
+}
+
+void test_split_frame()
+{
+	Client client;
+	std::vector<uint8_t> frame = request(1, 0x03, 0, 1);
+	TEST_ASSERT_TRUE(client.Send(frame.data(), 3));
+	TEST_ASSERT_TRUE(client.Send(frame.data() + 3, 5)); // header complete, PDU not
+	TEST_ASSERT_EQUAL(0, client.Responses.size());
+	TEST_ASSERT_TRUE(client.Send(frame.data() + 8, frame.size() - 8));
+	TEST_ASSERT_EQUAL(1, client.Responses.size());
+	TEST_ASSERT_EQUAL(53795, registerAt(client.Responses[0], 0));
+}
+
+void test_frames_in_one_segment()
+{
+	Client client;
+	std::vector<uint8_t> data = request(1, 0x03, 0, 1);
+	std::vector<uint8_t> second = request(2, 0x04, 0, 1);
+	std::vector<uint8_t> third = request(1, 0x06, 0, 1);
+	data.insert(data.end(), second.begin(), second.end());
+	data.insert(data.end(), third.begin(), third.begin() + 4); // rest in the next segment
+	TEST_ASSERT_TRUE(client.Send(data));
+	TEST_ASSERT_EQUAL(2, client.Responses.size());
+	TEST_ASSERT_EQUAL(53795, registerAt(client.Responses[0], 0));
+	TEST_ASSERT_EQUAL(52000, registerAt(client.Responses[1], 0));
+	TEST_ASSERT_TRUE(client.Send(third.data() + 4, third.size() - 4));
+	TEST_ASSERT_EQUAL(3, client.Responses.size());
+	assertException(client.Responses[2], 0x06, 0x01);
+}
+
+// more requests than the buffer holds in one segment, each is answered as it completes
+void test_segment_longer_than_buffer()
+{
+	Client client;
+	std::vector<uint8_t> data;
+	for (int i = 0; i < 40; i++)
+	{
+		std::vector<uint8_t> frame = request(1, 0x03, i, 1);
+		data.insert(data.end(), frame.begin(), frame.end());
+	}
+	TEST_ASSERT_GREATER_THAN(MODBUS_MAX_FRAME, data.size());
+	TEST_ASSERT_TRUE(client.Send(data));
+	TEST_ASSERT_EQUAL(40, client.Responses.size());
+	TEST_ASSERT_EQUAL(11, registerAt(client.Responses[5], 0));
+}
+
+void test_mbap_length_errors()
+{
+	Client tooShort;
+	std::vector<uint8_t> frame = request(1, 0x03, 0, 1);
+	frame[5] = 1; // unit id only
+	TEST_ASSERT_FALSE(tooShort.Send(frame));
+	TEST_ASSERT_EQUAL(0, tooShort.Responses.size());
+
+	Client tooLong;
+	frame = request(1, 0x03, 0, 1);
+	frame[4] = (MODBUS_MAX_FRAME - 5) >> 8;
+	frame[5] = (MODBUS_MAX_FRAME - 5) & 0xFF;
+	TEST_ASSERT_FALSE(tooLong.Send(frame.data(), MBAP_SIZE)); // rejected on the header, before the PDU arrives
+	TEST_ASSERT_EQUAL(MODBUS_MAX_FRAME + 1, tooLong.Connection.FrameLength());
+
+	Client longest; // a 260 byte frame is the largest allowed, answered with the request's own length field
+	frame = request(1, 0x03, 0, 1);
+	frame[4] = (MODBUS_MAX_FRAME - 6) >> 8;
+	frame[5] = (MODBUS_MAX_FRAME - 6) & 0xFF;
+	frame.resize(MODBUS_MAX_FRAME);
+	TEST_ASSERT_TRUE(longest.Send(frame));
+	TEST_ASSERT_EQUAL(1, longest.Responses.size());
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_read_holding_registers);
+	RUN_TEST(test_read_input_registers);
+	RUN_TEST(test_read_bank);
+	RUN_TEST(test_illegal_function);
+	RUN_TEST(test_illegal_quantity);
+	RUN_TEST(test_out_of_range_address);
+	RUN_TEST(test_unknown_unit);
+	RUN_TEST(test_not_modbus);
+	RUN_TEST(test_split_frame);
+	RUN_TEST(test_frames_in_one_segment);
+	RUN_TEST(test_segment_longer_than_buffer);
+	RUN_TEST(test_mbap_length_errors);
+	return UNITY_END();
+}
@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+"""Decode the binary trace ring served by the ESP32 on /trace.
+
+usage: trace_decode.py <dump file or http://<ip>:7667/trace> [TraceEvents.h]
+"""
+
+import os
+import re
+import struct
+import sys
+import urllib.request
+
+RECORD = struct.Struct("<IIHBB4I")  # TraceRecord in Trace.h
+DEFAULT_EVENTS = os.path.join(os.path.dirname(__file__), "..", "PylonToMQTT", "include", "TraceEvents.h")
+
+
+def load_formats(path):
+    with open(path) as f:
+        text = f.read()
+    events = re.findall(r'X\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', text)
+    bank = re.search(r'#define TRACE_BANK (\w+)', text)
+    bank_format = re.search(r'#define TRACE_BANK_FORMAT "((?:[^"\\]|\\.)*)"', text)
+    return events, int(bank.group(1), 0), bank_format.group(1)
+
+
+def load_dump(source):
+    if source.startswith("http://"):
+        with urllib.request.urlopen(source) as response:
+            return response.read()
+    with open(source, "rb") as f:
+        return f.read()
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        return 1
+    events, bank, bank_format = load_formats(sys.argv[2] if len(sys.argv) > 2 else DEFAULT_EVENTS)
+    data = load_dump(sys.argv[1])
+    records = [RECORD.unpack_from(data, offset) for offset in range(0, len(data) - RECORD.size + 1, RECORD.size)]
+    for sequence, timestamp, event, count, _, *args in sorted(records):
+        if event < len(events):
+            name, fmt = events[event]
+            if name == "PUBLISH_READINGS" and count > 0 and args[0] == bank:
+                fmt, args, count = bank_format, args[1:], count - 1  # readings/bank message
+            text = fmt % tuple(args[:count])
+        else:
+            text = "unknown event %d %s" % (event, args[:count])
+        print("[%10u][%8u] %s" % (timestamp, sequence, text))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())